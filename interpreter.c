@@ -8,12 +8,48 @@
 #include <stdbool.h>
 #include <ctype.h>
 #include <errno.h>
+#include <dlfcn.h>
 
+// Runs a script that --emit-c translated and that was built with
+// -shared -fPIC. Its l_* calls bind to this executable's copy.
+static int runLibrary(const char *libraryPath) {
+    void *library = dlopen(libraryPath, RTLD_NOW);
+    if (library == NULL) {
+        fprintf(stderr, "Error: %s\n", dlerror());
+        return 1;
+    }
+    void (*run)(l_interpreter_t *interpreter);
+    *(void **)(&run) = dlsym(library, "l_script_run");
+    if (run == NULL) {
+        fprintf(stderr, "Error: %s\n", dlerror());
+        dlclose(library);
+        return 1;
+    }
+    l_interpreter_t *interpreter = l_interpreter_create();
+    run(interpreter);
+    l_interpreter_destroy(interpreter);
+    dlclose(library);
+    return 0;
+}
 
 int main(int argc, char **argv) {
+    // usage: interpreter [--emit-c] [script.lisp | -]
+    //        interpreter --load script.so
+    bool emitC = false;
+    const char *scriptPath = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--emit-c") == 0) {
+            emitC = true;
+        } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+            return runLibrary(argv[++i]);
+        } else {
+            scriptPath = argv[i];
+        }
+    }
+
     FILE *scriptF;
-    if (argc == 2 && strcmp(argv[1], "-") != 0) {
-        scriptF = fopen(argv[1], "r");
+    if (scriptPath != NULL && strcmp(scriptPath, "-") != 0) {
+        scriptF = fopen(scriptPath, "r");
     } else {
         scriptF = stdin;
     }
@@ -34,8 +70,17 @@ int main(int argc, char **argv) {
     }
     fread(script, 1, scriptSize, scriptF);
     script[scriptSize] = '\0';
+    if (scriptF != stdin) {
+        fclose(scriptF);
+    }
 
    l_interpreter_t *interpreter = l_interpreter_create(); 
+   if (emitC) {
+       int status = l_emit_c(interpreter, script, stdout);
+       free(script);
+       l_interpreter_destroy(interpreter);
+       return status;
+   }
    l_value_t result = l_interpreter_eval(interpreter, script);
    (void) result;
    free(script);
@@ -9,6 +9,17 @@
 #include <math.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ucontext.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
 
 
 
@@ -20,7 +31,10 @@ typedef enum lValueType {
     L_VALUE_BOOL,
     L_VALUE_NIL,
     L_VALUE_SYMBOL,
-    L_VALUE_LIST
+    L_VALUE_LIST,
+    L_VALUE_VECTOR,
+    L_VALUE_MAP,
+    L_VALUE_TASK
 } l_value_type_t;
 
 #define L_VALUE_FLAG_NONE 0
@@ -45,15 +59,172 @@ typedef struct lValue {
         char character;
         bool boolean;
         l_vector_t list;
+        struct lPVector *vector;
+        struct lHashMap *map;
+        struct lRope *rope;
+        struct lTask *task;
     } value;
     char flags;
     
 } l_value_t;
 
-//TODO: make this a hash table
+// Persistent vector: a 32-way trie of full leaves plus a separate tail leaf,
+// so appends touch only the tail and updates copy one path of O(log32 n)
+// nodes. Nodes and headers are reference counted and shared between
+// versions; an operation on a header or node nobody else references
+// mutates it in place instead of copying.
+#define L_PVECTOR_BITS 5
+#define L_PVECTOR_WIDTH (1 << L_PVECTOR_BITS)
+#define L_PVECTOR_MASK (L_PVECTOR_WIDTH - 1)
+
+typedef struct lPVectorNode {
+    size_t ref_count;
+    size_t length;
+    bool leaf;
+    union {
+        struct lPVectorNode *children[L_PVECTOR_WIDTH];
+        l_value_t values[L_PVECTOR_WIDTH];
+    } slots;
+} l_pvector_node_t;
+
+typedef struct lPVector {
+    size_t ref_count;
+    size_t count;
+    unsigned shift;
+    l_pvector_node_t *root;
+    l_pvector_node_t *tail;
+} l_pvector_t;
+
+// Persistent hash map: a hash array mapped trie consuming L_PVECTOR_BITS of
+// the key hash per level. Keys whose hashes are fully equal end up in a
+// collision node that is scanned linearly.
+typedef struct lHamtEntry {
+    struct lHamtNode *child; // non-NULL: the entry is a sub-trie, key and value are unused
+    size_t hash;
+    l_value_t key;
+    l_value_t value;
+} l_hamt_entry_t;
+
+typedef struct lHamtNode {
+    size_t ref_count;
+    uint32_t bitmap;
+    bool collision;
+    size_t length;
+    l_hamt_entry_t entries[];
+} l_hamt_node_t;
+
+typedef struct lHashMap {
+    size_t ref_count;
+    size_t count;
+    l_hamt_node_t *root;
+} l_hash_map_t;
+
+// String values are ropes rather than interned char*, so concatenation and
+// slicing share the existing characters instead of copying them. Slices
+// always point at a leaf. Pieces up to L_ROPE_SHORT characters are copied
+// into flat leaves, and a concatenation deeper than L_ROPE_MAX_DEPTH is
+// rebuilt balanced.
+#define L_ROPE_SHORT 64
+#define L_ROPE_MAX_DEPTH 48
+
+typedef enum lRopeKind {
+    L_ROPE_LEAF,
+    L_ROPE_CONCAT,
+    L_ROPE_SLICE
+} l_rope_kind_t;
+
+typedef struct lRope {
+    size_t ref_count;
+    size_t length;
+    unsigned depth;
+    l_rope_kind_t kind;
+    union {
+        struct {
+            char *data;
+            size_t capacity;
+        } leaf;
+        struct {
+            struct lRope *left;
+            struct lRope *right;
+        } concat;
+        struct {
+            struct lRope *source;
+            size_t offset;
+        } slice;
+    } node;
+} l_rope_t;
+
+// Tasks are coroutines with their own stack, evaluating one expression.
+// They switch to the scheduler loop, which runs on the main context,
+// whenever they yield, await an unfinished task, sleep or wait for a file
+// descriptor; the loop resumes them once they are ready again.
+// A task's stack is reserved at the size of a default main thread stack;
+// pages are only committed as the task touches them.
+#define L_TASK_STACK_SIZE (8 * 1024 * 1024)
+// Nesting limit for l_interpreter_execute, well inside either kind of stack.
+#define L_MAX_DEPTH 4096
+
+typedef struct lTask {
+    size_t ref_count;
+    struct lInterpreter *interpreter;
+    ucontext_t context;
+    void *stack; // guard page, then L_TASK_STACK_SIZE of stack
+    size_t depth; // nesting of l_interpreter_execute on this task
+    l_value_t expression;
+    l_value_t result;
+    bool done;
+    struct lTask *next; // ready queue or the waiters of another task
+    struct lTask *waiters;
+    struct lTask *live_prev;
+    struct lTask *live_next;
+} l_task_t;
+
+typedef struct lTimer {
+    long long deadline; // CLOCK_MONOTONIC nanoseconds
+    l_task_t *task; // NULL for the main context
+} l_timer_t;
+
+// Everything waiting on one file descriptor. epoll_fd holds a single
+// registration per descriptor, for the union of what its waiters want.
+typedef struct lIoWatch {
+    l_task_t *readers; // linked through next
+    l_task_t *writers;
+    bool main_reads;
+    bool main_writes;
+    uint32_t events; // registered in epoll_fd, 0 if not registered
+    bool made_nonblocking; // O_NONBLOCK was set here and is cleared again at exit
+} l_io_watch_t;
+
+typedef struct lScheduler {
+    int epoll_fd;
+    l_vector_t timers; // <l_timer_t>, a binary min-heap on deadline
+    l_vector_t watches; // <l_io_watch_t>, indexed by file descriptor
+    ucontext_t main_context;
+    l_task_t *current; // NULL while on the main context
+    l_task_t *ready_head;
+    l_task_t *ready_tail;
+    l_task_t *live; // unfinished tasks
+    size_t waiting; // tasks and main context waiting on file descriptors
+    bool main_woken;
+} l_scheduler_t;
+
+typedef struct lTableEntry {
+    l_value_t key;
+    l_value_t value;
+    size_t hash;
+    bool occupied;
+    bool referenced; // read since the clock hand last passed
+} l_table_entry_t;
+
+// Open addressing with linear probing, keyed structurally through
+// l_value_hash and l_value_equal like the HAMT.
 typedef struct lTable {
-    l_vector_t keys;
-    l_vector_t values;
+    l_table_entry_t *slots;
+    size_t capacity; // power of two, at least twice count
+    size_t count;
+    size_t max_count; // 0 for unbounded
+    size_t clock_hand;
+    size_t evictions;
 } l_table_t;
 
 typedef struct lRefCounted {
@@ -67,10 +238,93 @@ typedef struct lEnvironment {
     struct lEnvironment *parent;
 } l_environment_t;
 
+// Builtins called with evaluated arguments, in l_builtin_t order, each with
+// the l_builtin_<group> function that implements it. l_builtin_call and the
+// emitter both dispatch from this list.
+#define L_CALLABLE_BUILTINS(X) \
+    X(ADD, arithmetic) X(SUB, arithmetic) X(MUL, arithmetic) X(DIV, arithmetic) \
+    X(LT, compare) X(GT, compare) X(EQ, compare) \
+    X(VECTOR, collection) X(HASH_MAP, collection) X(ASSOC, collection) \
+    X(GET, collection) X(CONJ, collection) X(UPDATE, collection) X(COUNT, collection) \
+    X(STR, string) X(SUBSTRING, string) X(STRING_LENGTH, string) \
+    X(STRING_REF, string) X(INTERN, string) \
+    X(YIELD, async) X(AWAIT, async) X(SLEEP, async) X(FD_READ, async) \
+    X(FD_WRITE, async) X(FD_CLOSE, async) X(FILE_OPEN, async) \
+    X(UNIX_CONNECT, async) X(UNIX_LISTEN, async) X(UNIX_ACCEPT, async) \
+    X(MEMOIZE_LIMIT, stats) X(STATS, stats)
+
+typedef enum lBuiltin {
+#define L_BUILTIN_ENUMERATOR(name, group) L_BUILTIN_##name,
+    L_CALLABLE_BUILTINS(L_BUILTIN_ENUMERATOR)
+#undef L_BUILTIN_ENUMERATOR
+    L_BUILTIN_QUOTE,
+    L_BUILTIN_SPAWN,
+    L_BUILTIN_MEMOIZE,
+
+    L_BUILTIN_NONE
+} l_builtin_t;
+
+typedef struct lBuiltinName {
+    const char *name;
+    l_builtin_t builtin;
+} l_builtin_name_t;
+
+static const l_builtin_name_t l_builtin_names[] = {
+    {"+", L_BUILTIN_ADD}, {"add", L_BUILTIN_ADD},
+    {"-", L_BUILTIN_SUB}, {"sub", L_BUILTIN_SUB},
+    {"*", L_BUILTIN_MUL}, {"mul", L_BUILTIN_MUL},
+    {"/", L_BUILTIN_DIV}, {"div", L_BUILTIN_DIV},
+    {"<", L_BUILTIN_LT},
+    {">", L_BUILTIN_GT},
+    {"=", L_BUILTIN_EQ},
+    {"vector", L_BUILTIN_VECTOR},
+    {"hash-map", L_BUILTIN_HASH_MAP},
+    {"assoc", L_BUILTIN_ASSOC},
+    {"get", L_BUILTIN_GET},
+    {"conj", L_BUILTIN_CONJ},
+    {"update", L_BUILTIN_UPDATE},
+    {"count", L_BUILTIN_COUNT},
+    {"str", L_BUILTIN_STR},
+    {"substring", L_BUILTIN_SUBSTRING},
+    {"string-length", L_BUILTIN_STRING_LENGTH},
+    {"string-ref", L_BUILTIN_STRING_REF},
+    {"intern", L_BUILTIN_INTERN},
+    {"yield", L_BUILTIN_YIELD},
+    {"await", L_BUILTIN_AWAIT},
+    {"sleep", L_BUILTIN_SLEEP},
+    {"fd-read", L_BUILTIN_FD_READ},
+    {"fd-write", L_BUILTIN_FD_WRITE},
+    {"fd-close", L_BUILTIN_FD_CLOSE},
+    {"file-open", L_BUILTIN_FILE_OPEN},
+    {"unix-connect", L_BUILTIN_UNIX_CONNECT},
+    {"unix-listen", L_BUILTIN_UNIX_LISTEN},
+    {"unix-accept", L_BUILTIN_UNIX_ACCEPT},
+    {"memoize-limit", L_BUILTIN_MEMOIZE_LIMIT},
+    {"stats", L_BUILTIN_STATS},
+    {"quote", L_BUILTIN_QUOTE},
+    {"spawn", L_BUILTIN_SPAWN},
+    {"memoize", L_BUILTIN_MEMOIZE},
+};
+#define L_BUILTIN_NAME_COUNT (sizeof(l_builtin_names) / sizeof(l_builtin_names[0]))
+
+typedef struct lInterpreterStats {
+    size_t memo_hits;
+    size_t memo_misses;
+} l_interpreter_stats_t;
+
+#define L_MEMO_DEFAULT_LIMIT 1024
+
 typedef struct lInterpreter {
     //l_environment_t *global_environment;
     //l_environment_t *current_environment;
     l_vector_t *string_table; //<RefCounted<char*>>
+    // symbol indices of l_builtin_names, interned once so that dispatch
+    // compares indices instead of strings
+    size_t builtin_symbols[L_BUILTIN_NAME_COUNT];
+    l_scheduler_t *scheduler; // created on first use
+    size_t depth; // nesting of l_interpreter_execute on the main context
+    l_table_t memo; // (f args...) -> result, for memoize
+    l_interpreter_stats_t stats;
 } l_interpreter_t;
 
 typedef enum lTokenType {
@@ -84,6 +338,10 @@ typedef enum lTokenType {
     TOKEN_STRING,
     TOKEN_BOOLEAN,
     TOKEN_CHARACTER,
+    TOKEN_LBRACKET,
+    TOKEN_RBRACKET,
+    TOKEN_LBRACE,
+    TOKEN_RBRACE,
 
     TOKEN_EOF,
     TOKEN_ERROR
@@ -120,12 +378,14 @@ l_value_t l_interpreter_eval(l_interpreter_t* interpreter, const char* source);
 l_value_t l_interpreter_execute(l_interpreter_t *interpreter, l_value_t s_expression);
 
 void l_debug_print_value(l_value_t *value, l_vector_t *string_table);
+void l_fprint_value(FILE *out, l_value_t *value, l_vector_t *string_table);
 void l_debug_print_token(l_token_t *token);
 
 l_token_t l_tokenizer_next(l_tokenizer_t *tokenizer);
 
 l_value_t l_parse_expression(l_token_t first, l_tokenizer_t *tokenizer, l_vector_t **string_table);
 l_value_t l_parse_list(l_tokenizer_t *tokenizer, l_vector_t **string_table);
+l_value_t l_parse_collection(l_tokenizer_t *tokenizer, l_vector_t **string_table, const char *constructor, l_token_type_t closing);
 l_value_t l_parse_atom(l_token_t *token, l_vector_t **string_table);
 l_value_t l_parse_quote(l_tokenizer_t *tokenizer, l_vector_t **string_table);
 
@@ -134,8 +394,11 @@ void l_vector_destroy(l_vector_t *vector);
 void l_vector_push(l_vector_t *vector, void *element);
 void *l_vector_get(l_vector_t *vector, size_t index);
 
-void l_table_init(l_table_t *table, size_t key_size, size_t value_size, size_t initial_capacity);
+void l_table_init(l_table_t *table, size_t initial_capacity);
 void l_table_destroy(l_table_t *table);
+l_value_t *l_table_get(l_table_t *table, l_value_t *key);
+void l_table_set(l_table_t *table, l_value_t key, l_value_t value);
+void l_table_set_limit(l_table_t *table, size_t max_count);
 
 size_t l_intern_string(l_vector_t **string_table, const char *string, bool eternal);
 const char *l_get_interned_string(l_vector_t *string_table, size_t index);
@@ -147,7 +410,61 @@ void l_environment_init(l_environment_t *environment, l_environment_t *parent);
 void l_environment_destroy(l_environment_t *environment);
 
 void l_value_destroy(l_value_t *value);
+l_value_t l_value_copy(l_value_t *value);
+l_value_t l_value_integer(long long number);
+l_value_t l_value_real(double number);
+l_value_t l_value_bool(bool boolean);
+l_value_t l_value_nil(void);
+l_value_t l_value_character(char character);
+l_value_t l_value_string(const char *string);
+l_value_t l_value_symbol(l_vector_t **string_table, const char *name);
+l_value_t l_value_list(l_value_t *elements, size_t count);
+l_value_t l_value_error(l_vector_t **string_table, const char *fmt, ...);
+size_t l_value_hash(l_value_t *value);
+bool l_value_equal(l_value_t *a, l_value_t *b);
+
+l_pvector_t *l_pvector_create(void);
+void l_pvector_release(l_pvector_t *vector);
+l_value_t *l_pvector_get(l_pvector_t *vector, size_t index);
+l_pvector_t *l_pvector_conj(l_pvector_t *vector, l_value_t value);
+l_pvector_t *l_pvector_assoc(l_pvector_t *vector, size_t index, l_value_t value);
+
+l_hash_map_t *l_hash_map_create(void);
+void l_hash_map_release(l_hash_map_t *map);
+l_value_t *l_hash_map_get(l_hash_map_t *map, l_value_t *key);
+l_hash_map_t *l_hash_map_assoc(l_hash_map_t *map, l_value_t key, l_value_t value);
+void l_hash_map_each(l_hash_map_t *map, void (*visit)(l_value_t *key, l_value_t *value, void *context), void *context);
+
+l_rope_t *l_rope_from_buffer(char *data, size_t length);
+l_rope_t *l_rope_from_string(const char *string, size_t length);
+void l_rope_release(l_rope_t *rope);
+l_rope_t *l_rope_concat(l_rope_t *left, l_rope_t *right);
+l_rope_t *l_rope_slice(l_rope_t *rope, size_t start, size_t end);
+char l_rope_char_at(l_rope_t *rope, size_t index);
+const char *l_rope_flatten(l_rope_t *rope);
+bool l_rope_equal(l_rope_t *a, l_rope_t *b);
+size_t l_rope_hash(l_rope_t *rope);
+
+l_value_t l_task_spawn(l_interpreter_t *interpreter, l_value_t *expression);
+void l_task_release(l_task_t *task);
+void l_scheduler_destroy(l_scheduler_t *scheduler);
+void l_interpreter_drain(l_interpreter_t *interpreter);
+
+l_builtin_t l_interpreter_lookup_builtin(l_interpreter_t *interpreter, size_t symbol_index);
+l_value_t l_builtin_call(l_interpreter_t *interpreter, l_builtin_t builtin, l_value_t *args, size_t count);
+l_value_t l_builtin_arithmetic(l_interpreter_t *interpreter, l_builtin_t builtin, l_value_t *args, size_t count);
+l_value_t l_builtin_compare(l_interpreter_t *interpreter, l_builtin_t builtin, l_value_t *args, size_t count);
+l_value_t l_builtin_collection(l_interpreter_t *interpreter, l_builtin_t builtin, l_value_t *args, size_t count);
+l_value_t l_builtin_string(l_interpreter_t *interpreter, l_builtin_t builtin, l_value_t *args, size_t count);
+l_value_t l_builtin_async(l_interpreter_t *interpreter, l_builtin_t builtin, l_value_t *args, size_t count);
+l_value_t l_builtin_stats(l_interpreter_t *interpreter, l_builtin_t builtin, l_value_t *args, size_t count);
+
+int l_emit_c(l_interpreter_t *interpreter, const char *source, FILE *out);
+// Code that a process already holding the implementation loads, like the
+// scripts --emit-c writes, defines this to bind to that copy instead.
+#ifndef L_INTERPRETER_DECLARATIONS_ONLY
 #define L_INTERPRETER_IMPLEMENTATION 1
+#endif
 
 
 
@@ -200,6 +517,134 @@ void *l_vector_get(l_vector_t *vector, size_t index) {
     return (char *)vector->data + index * vector->element_size;
 }
 
+void l_table_init(l_table_t *table, size_t initial_capacity) {
+    size_t capacity = 8;
+    while(capacity < initial_capacity * 2) {
+        capacity *= 2;
+    }
+    table->slots = (l_table_entry_t *)calloc(capacity, sizeof(l_table_entry_t));
+    table->capacity = capacity;
+    table->count = 0;
+    table->max_count = 0;
+    table->clock_hand = 0;
+    table->evictions = 0;
+}
+
+void l_table_destroy(l_table_t *table) {
+    for(size_t i = 0; i < table->capacity; i++) {
+        if(table->slots[i].occupied) {
+            l_value_destroy(&table->slots[i].key);
+            l_value_destroy(&table->slots[i].value);
+        }
+    }
+    free(table->slots);
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+// Returns the slot holding key, or the empty slot where it would go.
+static size_t l_table_find(l_table_t *table, l_value_t *key, size_t hash) {
+    size_t mask = table->capacity - 1;
+    for(size_t i = hash & mask;; i = (i + 1) & mask) {
+        l_table_entry_t *slot = &table->slots[i];
+        if(!slot->occupied || (slot->hash == hash && l_value_equal(&slot->key, key))) {
+            return i;
+        }
+    }
+}
+
+static void l_table_grow(l_table_t *table) {
+    l_table_entry_t *slots = table->slots;
+    size_t capacity = table->capacity;
+    table->capacity *= 2;
+    table->slots = (l_table_entry_t *)calloc(table->capacity, sizeof(l_table_entry_t));
+    for(size_t i = 0; i < capacity; i++) {
+        if(slots[i].occupied) {
+            table->slots[l_table_find(table, &slots[i].key, slots[i].hash)] = slots[i];
+        }
+    }
+    free(slots);
+}
+
+// Empties slot i, shifting later entries of its probe run back so that
+// lookups need no tombstones.
+static void l_table_remove_slot(l_table_t *table, size_t i) {
+    size_t mask = table->capacity - 1;
+    l_value_destroy(&table->slots[i].key);
+    l_value_destroy(&table->slots[i].value);
+    table->slots[i].occupied = false;
+    table->count--;
+    for(size_t j = (i + 1) & mask; table->slots[j].occupied; j = (j + 1) & mask) {
+        size_t home = table->slots[j].hash & mask;
+        bool stays = i < j ? (home > i && home <= j) : (home > i || home <= j);
+        if(!stays) {
+            table->slots[i] = table->slots[j];
+            table->slots[j].occupied = false;
+            i = j;
+        }
+    }
+}
+
+// CLOCK: sweep the slots, giving entries read since the last sweep another
+// round and evicting the first one that was not.
+static void l_table_evict(l_table_t *table) {
+    for(;; table->clock_hand = (table->clock_hand + 1) & (table->capacity - 1)) {
+        l_table_entry_t *slot = &table->slots[table->clock_hand];
+        if(!slot->occupied) {
+            continue;
+        }
+        if(slot->referenced) {
+            slot->referenced = false;
+            continue;
+        }
+        l_table_remove_slot(table, table->clock_hand);
+        table->evictions++;
+        return;
+    }
+}
+
+l_value_t *l_table_get(l_table_t *table, l_value_t *key) {
+    l_table_entry_t *slot = &table->slots[l_table_find(table, key, l_value_hash(key))];
+    if(!slot->occupied) {
+        return NULL;
+    }
+    slot->referenced = true;
+    return &slot->value;
+}
+
+// Consumes key and value. A table with max_count set evicts an entry
+// instead of growing past it.
+void l_table_set(l_table_t *table, l_value_t key, l_value_t value) {
+    size_t hash = l_value_hash(&key);
+    size_t i = l_table_find(table, &key, hash);
+    if(table->slots[i].occupied) {
+        l_value_destroy(&table->slots[i].value);
+        l_value_destroy(&key);
+        table->slots[i].value = value;
+        table->slots[i].referenced = true;
+        return;
+    }
+    if(table->max_count > 0 && table->count >= table->max_count) {
+        l_table_evict(table);
+        i = l_table_find(table, &key, hash);
+    }
+    if((table->count + 1) * 2 > table->capacity) {
+        l_table_grow(table);
+        i = l_table_find(table, &key, hash);
+    }
+    // new entries start unreferenced, so values used only once go first
+    table->slots[i] = (l_table_entry_t) {.key = key, .value = value, .hash = hash, .occupied = true};
+    table->count++;
+}
+
+void l_table_set_limit(l_table_t *table, size_t max_count) {
+    table->max_count = max_count;
+    while(max_count > 0 && table->count > max_count) {
+        l_table_evict(table);
+    }
+}
+
 
 static bool isSymbol(char c) {
     return isalpha(c) || c == '_' || c == '+' || c == '-' || c == '*' || c == '/' || c == '=' || c == '<' || c == '>' || c == '?' || c == '!';
@@ -230,7 +675,8 @@ l_token_t l_tokenizer_next(l_tokenizer_t *tokenizer) {
 #define HAS_CHARS(n) (tokenizer->offset + n < tokenizer->data_length)
 
 #define IS_TOKEN_SEPARATOR(c) \
-    (c == ' ' || c == '\n' || c == '\t' || c == '\0' || c == '(' || c == ')' || c == '\'')
+    (c == ' ' || c == '\n' || c == '\t' || c == '\0' || c == '(' || c == ')' || c == '\'' \
+     || c == '[' || c == ']' || c == '{' || c == '}')
 
 
 #define REQUIRE_CHARS(n, MSG)                                                   \
@@ -262,6 +708,22 @@ l_token_t l_tokenizer_next(l_tokenizer_t *tokenizer) {
         ADVANCE(1);
         return (l_token_t) {.type = TOKEN_RPAREN};
     }
+    if(NEXT_CHAR(0) == '[') {
+        ADVANCE(1);
+        return (l_token_t) {.type = TOKEN_LBRACKET};
+    }
+    if(NEXT_CHAR(0) == ']') {
+        ADVANCE(1);
+        return (l_token_t) {.type = TOKEN_RBRACKET};
+    }
+    if(NEXT_CHAR(0) == '{') {
+        ADVANCE(1);
+        return (l_token_t) {.type = TOKEN_LBRACE};
+    }
+    if(NEXT_CHAR(0) == '}') {
+        ADVANCE(1);
+        return (l_token_t) {.type = TOKEN_RBRACE};
+    }
     if(NEXT_CHAR(0) == '\'') {
         ADVANCE(1);
         return (l_token_t) {.type = TOKEN_QUOTE};
@@ -441,188 +903,2597 @@ l_value_t l_interpreter_eval(l_interpreter_t *interpreter, const char *source) {
     tokenizer.data_length = strlen(source);
 
     l_token_t first = l_tokenizer_next(&tokenizer);
-    l_value_t result;
+    // the value of the last form is handed to the caller, which destroys it
+    l_value_t result = l_value_nil();
     while(first.type != TOKEN_EOF) {
-        result = l_parse_expression(first, &tokenizer, &interpreter->string_table);
-        l_debug_print_value(&result, interpreter->string_table);
+        l_value_t expression = l_parse_expression(first, &tokenizer, &interpreter->string_table);
+        l_debug_print_value(&expression, interpreter->string_table);
+        l_value_destroy(&result);
+        result = expression;
 
         if(result.type == L_VALUE_ERROR) {
             break;
         }
 
-        if(result.type == L_VALUE_LIST) {
-            result = l_interpreter_execute(interpreter, result);
-        }
+        result = l_interpreter_execute(interpreter, expression);
+        l_value_destroy(&expression);
+        printf(" => ");
+        l_debug_print_value(&result, interpreter->string_table);
 
         printf("\n");
-        l_value_destroy(&result);
+        // tasks write to descriptors directly, keep the lines in order with them
+        fflush(stdout);
         first = l_tokenizer_next(&tokenizer);
     }
+    l_interpreter_drain(interpreter);
 
     return result;
 }
 
-l_value_t l_interpreter_execute(l_interpreter_t *interpreter, l_value_t s_expression) {
-    (void) interpreter;
-    (void) s_expression;
-
-    return s_expression;
+static bool l_builtin_is_pure(l_builtin_t builtin) {
+    switch(builtin) {
+        case L_BUILTIN_ADD:
+        case L_BUILTIN_SUB:
+        case L_BUILTIN_MUL:
+        case L_BUILTIN_DIV:
+        case L_BUILTIN_LT:
+        case L_BUILTIN_GT:
+        case L_BUILTIN_EQ:
+        case L_BUILTIN_VECTOR:
+        case L_BUILTIN_HASH_MAP:
+        case L_BUILTIN_ASSOC:
+        case L_BUILTIN_GET:
+        case L_BUILTIN_CONJ:
+        case L_BUILTIN_UPDATE:
+        case L_BUILTIN_COUNT:
+        case L_BUILTIN_STR:
+        case L_BUILTIN_SUBSTRING:
+        case L_BUILTIN_STRING_LENGTH:
+        case L_BUILTIN_STRING_REF:
+        case L_BUILTIN_INTERN:
+            return true;
+        default:
+            return false;
+    }
 }
 
-l_value_t l_parse_expression(l_token_t first, l_tokenizer_t *tokenizer, l_vector_t **string_table) {
-    //l_token_t token = l_tokenizer_next(tokenizer);
-    const char *err_where = NULL;
-    const char *err_why = NULL;
-    switch(first.type) {
-        case TOKEN_LPAREN:
-            return l_parse_list(tokenizer, string_table);
-        case TOKEN_QUOTE:
-            return l_parse_quote(tokenizer, string_table);
-        case TOKEN_REAL:
-        case TOKEN_INTEGER:
-        case TOKEN_STRING:
-        case TOKEN_BOOLEAN:
-        case TOKEN_CHARACTER:
-        case TOKEN_SYMBOL:
-            return l_parse_atom(&first, string_table);
-        case TOKEN_ERROR:
-            err_where = "tokenization";
-            err_why = first.value.error_message;
-            break;
-        case TOKEN_EOF:
-            err_where = "parsing";
-            err_why = "unexpected end of file";
-            break;
-        case TOKEN_RPAREN:
-            err_where = "parsing";
-            err_why = "unexpected ')'";
-            break;
-        default:
-            err_where = "parsing";
-            err_why = "unhandled token type";
+// update calls the builtin named by its third argument, passing its later
+// arguments shifted down by two. Returns the builtin a chain of updates ends
+// in, or update itself when the chain is malformed and update will say so.
+static l_builtin_t l_update_target(l_interpreter_t *interpreter, l_value_t *args, size_t count) {
+    l_builtin_t builtin = L_BUILTIN_UPDATE;
+    for(size_t function = 2; builtin == L_BUILTIN_UPDATE; function += 2) {
+        l_builtin_t next = function < count && args[function].type == L_VALUE_SYMBOL
+            ? l_interpreter_lookup_builtin(interpreter, args[function].value.symbol_index) : L_BUILTIN_NONE;
+        if(next == L_BUILTIN_NONE) {
             break;
+        }
+        builtin = next;
     }
-    char *error_message;
-    asprintf(&error_message, "Error while parsing token type %d: where: %s why: %s", first.type, err_where, err_why);
-    size_t interned_index = l_intern_string(string_table, error_message, false);
-    return (l_value_t) {.type = L_VALUE_ERROR, .value.string_index = interned_index};
+    return builtin;
 }
 
-l_interpreter_t* l_interpreter_create() {
-    l_interpreter_t* interpreter = (l_interpreter_t*)malloc(sizeof(l_interpreter_t));
-    interpreter->string_table = (l_vector_t*)malloc(sizeof(l_vector_t));
-    l_vector_init(interpreter->string_table, sizeof(l_ref_counted_t), 16, (void (*)(void *))l_ref_counted_destroy);
-    return interpreter;
+// (memoize (f args...)) evaluates the arguments and looks the call up in
+// the interpreter's memo table; only on a miss is f called. The key is a
+// list of f's l_builtin_t, so that aliases like + and add share entries,
+// followed by the argument values.
+static l_value_t l_interpreter_memoize(l_interpreter_t *interpreter, l_vector_t *list) {
+    if(list->length != 2) {
+        return l_value_error(&interpreter->string_table, "memoize expects 1 argument, got %zu", list->length - 1);
+    }
+    l_value_t *call = (l_value_t *)l_vector_get(list, 1);
+    l_value_t *head = call->type == L_VALUE_LIST ? (l_value_t *)l_vector_get(&call->value.list, 0) : NULL;
+    if(head == NULL || head->type != L_VALUE_SYMBOL) {
+        return l_value_error(&interpreter->string_table, "memoize expects a call to a builtin");
+    }
+    l_builtin_t builtin = l_interpreter_lookup_builtin(interpreter, head->value.symbol_index);
+    if(!l_builtin_is_pure(builtin)) {
+        return l_value_error(&interpreter->string_table, "memoize only caches calls to pure builtins, not %s",
+                l_get_interned_string(interpreter->string_table, head->value.symbol_index));
+    }
+
+    size_t count = call->value.list.length - 1;
+    l_value_t *elements = (l_value_t *)malloc(sizeof(l_value_t) * (count + 1));
+    elements[0] = l_value_integer(builtin);
+    for(size_t i = 0; i < count; i++) {
+        elements[i + 1] = l_interpreter_execute(interpreter, *(l_value_t *)l_vector_get(&call->value.list, i + 1));
+        if(elements[i + 1].type == L_VALUE_ERROR) {
+            l_value_t error = elements[i + 1];
+            for(size_t j = 1; j <= i; j++) {
+                l_value_destroy(&elements[j]);
+            }
+            free(elements);
+            return error;
+        }
+    }
+    l_value_t key = l_value_list(elements, count + 1);
+    free(elements);
+    l_builtin_t target = builtin == L_BUILTIN_UPDATE
+        ? l_update_target(interpreter, (l_value_t *)key.value.list.data + 1, count) : builtin;
+    if(!l_builtin_is_pure(target)) {
+        l_value_destroy(&key);
+        size_t name = 0;
+        while(l_builtin_names[name].builtin != target) {
+            name++;
+        }
+        return l_value_error(&interpreter->string_table, "memoize only caches calls to pure builtins, not update with %s",
+                l_builtin_names[name].name);
+    }
+
+    l_value_t *cached = l_table_get(&interpreter->memo, &key);
+    if(cached != NULL) {
+        interpreter->stats.memo_hits++;
+        l_value_destroy(&key);
+        return l_value_copy(cached);
+    }
+    interpreter->stats.memo_misses++;
+
+    // builtins may take their arguments, so call with copies and keep the key intact
+    l_value_t small_args[8];
+    l_value_t *args = count <= 8 ? small_args : (l_value_t *)malloc(sizeof(l_value_t) * count);
+    for(size_t i = 0; i < count; i++) {
+        args[i] = l_value_copy((l_value_t *)l_vector_get(&key.value.list, i + 1));
+    }
+    l_value_t result = l_builtin_call(interpreter, builtin, args, count);
+    for(size_t i = 0; i < count; i++) {
+        l_value_destroy(&args[i]);
+    }
+    if(args != small_args) {
+        free(args);
+    }
+    if(result.type == L_VALUE_ERROR) {
+        l_value_destroy(&key);
+    } else {
+        l_table_set(&interpreter->memo, key, l_value_copy(&result));
+    }
+    return result;
 }
 
-void l_interpreter_destroy(l_interpreter_t* interpreter) {
-    l_vector_destroy(interpreter->string_table);
-    free(interpreter->string_table);
-    free(interpreter);
+// Evaluates a call form; the callee is looked up from its head symbol.
+static l_value_t l_interpreter_call(l_interpreter_t *interpreter, l_vector_t *list) {
+    if(list->length == 0) {
+        return l_value_nil();
+    }
+    l_value_t *head = (l_value_t *)l_vector_get(list, 0);
+    if(head->type != L_VALUE_SYMBOL) {
+        return l_value_error(&interpreter->string_table, "Cannot call a value of type %d", head->type);
+    }
+    l_builtin_t builtin = l_interpreter_lookup_builtin(interpreter, head->value.symbol_index);
+    if(builtin == L_BUILTIN_NONE) {
+        return l_value_error(&interpreter->string_table, "Unknown function: %s",
+                l_get_interned_string(interpreter->string_table, head->value.symbol_index));
+    }
+    if(builtin == L_BUILTIN_QUOTE) {
+        if(list->length != 2) {
+            return l_value_error(&interpreter->string_table, "quote expects 1 argument, got %zu", list->length - 1);
+        }
+        return l_value_copy((l_value_t *)l_vector_get(list, 1));
+    }
+    if(builtin == L_BUILTIN_SPAWN) {
+        if(list->length != 2) {
+            return l_value_error(&interpreter->string_table, "spawn expects 1 argument, got %zu", list->length - 1);
+        }
+        return l_task_spawn(interpreter, (l_value_t *)l_vector_get(list, 1));
+    }
+    if(builtin == L_BUILTIN_MEMOIZE) {
+        return l_interpreter_memoize(interpreter, list);
+    }
+
+    // most calls are small, keep their arguments off the heap
+    l_value_t small_args[8];
+    size_t count = list->length - 1;
+    l_value_t *args = count <= 8 ? small_args : (l_value_t *)malloc(sizeof(l_value_t) * count);
+    size_t evaluated = 0;
+    l_value_t result;
+    for(; evaluated < count; evaluated++) {
+        args[evaluated] = l_interpreter_execute(interpreter, *(l_value_t *)l_vector_get(list, evaluated + 1));
+        if(args[evaluated].type == L_VALUE_ERROR) {
+            result = args[evaluated];
+            goto cleanup;
+        }
+    }
+    result = l_builtin_call(interpreter, builtin, args, count);
+
+cleanup:
+    for(size_t i = 0; i < evaluated; i++) {
+        l_value_destroy(&args[i]);
+    }
+    if(args != small_args) {
+        free(args);
+    }
+    return result;
 }
 
-void l_value_destroy(l_value_t *value) {
-    switch(value->type) {
-        case L_VALUE_NIL:
-        case L_VALUE_BOOL:
-        case L_VALUE_CHARACTER:
-        case L_VALUE_NUMBER:
-            break;
-        case L_VALUE_LIST:
-            l_vector_destroy(&value->value.list);
-            break;
-        case L_VALUE_STRING:
-            {
-                //TODO: dec refcount
-            }
-            break;
-        case L_VALUE_ERROR:
-            break;
+// Evaluates s_expression without taking ownership of it; the caller still
+// destroys the expression, and owns the returned value.
+l_value_t l_interpreter_execute(l_interpreter_t *interpreter, l_value_t s_expression) {
+    switch(s_expression.type) {
         case L_VALUE_SYMBOL:
+            return l_value_error(&interpreter->string_table, "Unbound symbol: %s",
+                    l_get_interned_string(interpreter->string_table, s_expression.value.symbol_index));
+        case L_VALUE_LIST:
             break;
+        default:
+            return l_value_copy(&s_expression);
     }
-}
-
-l_value_t l_parse_list(l_tokenizer_t *tokenizer, l_vector_t **string_table) {
-    l_value_t value = {.type = L_VALUE_LIST };
-    l_vector_init(&value.value.list, sizeof(l_value_t), 4, (void (*)(void *))l_value_destroy);
 
-    l_token_t token = l_tokenizer_next(tokenizer);
+    // tasks nest on their own stacks, so each context counts its own depth
+    l_scheduler_t *scheduler = interpreter->scheduler;
+    size_t *depth = scheduler != NULL && scheduler->current != NULL ? &scheduler->current->depth : &interpreter->depth;
+    if(*depth >= L_MAX_DEPTH) {
+        return l_value_error(&interpreter->string_table, "Expression nested deeper than %d levels", L_MAX_DEPTH);
+    }
+    (*depth)++;
+    l_value_t result = l_interpreter_call(interpreter, &s_expression.value.list);
+    (*depth)--;
+    return result;
+}
 
-    while(token.type != TOKEN_RPAREN) {
-        l_value_t expression = l_parse_expression(token, tokenizer, string_table);
-        if(expression.type == L_VALUE_ERROR) {
-            l_vector_destroy(&value.value.list);
-            return expression;
+l_builtin_t l_interpreter_lookup_builtin(l_interpreter_t *interpreter, size_t symbol_index) {
+    for(size_t i = 0; i < L_BUILTIN_NAME_COUNT; i++) {
+        if(interpreter->builtin_symbols[i] == symbol_index) {
+            return l_builtin_names[i].builtin;
         }
-        l_vector_push(&value.value.list, &expression);
-        token = l_tokenizer_next(tokenizer);
     }
-    return value;
+    return L_BUILTIN_NONE;
 }
 
-l_value_t l_parse_quote(l_tokenizer_t *tokenizer, l_vector_t **string_table) {
-    l_value_t value = {.type = L_VALUE_LIST };
-    l_vector_init(&value.value.list, sizeof(l_value_t), 2, (void (*)(void *))l_value_destroy);
-
-    l_value_t quote = {.type = L_VALUE_SYMBOL, .value.symbol_index = l_intern_string(string_table, "quote", true)};
-    l_vector_push(&value.value.list, &quote);
+// Builtins borrow their arguments; one may take ownership of an argument by
+// leaving nil in its slot, which lets collection updates on a temporary
+// happen in place.
+l_value_t l_builtin_call(l_interpreter_t *interpreter, l_builtin_t builtin, l_value_t *args, size_t count) {
+    switch(builtin) {
+#define L_BUILTIN_DISPATCH(name, group) \
+        case L_BUILTIN_##name: \
+            return l_builtin_##group(interpreter, builtin, args, count);
+        L_CALLABLE_BUILTINS(L_BUILTIN_DISPATCH)
+#undef L_BUILTIN_DISPATCH
+        default:
+            return l_value_error(&interpreter->string_table, "Builtin %d cannot be called with evaluated arguments", builtin);
+    }
+}
 
-    l_token_t token = l_tokenizer_next(tokenizer);
-    l_value_t expression = l_parse_expression(token, tokenizer, string_table);
-    if(expression.type == L_VALUE_ERROR) {
-        return expression;
+static double l_number_as_double(l_value_t *value) {
+    if(value->flags & L_VALUE_FLAG_INTEGER) {
+        return (double)value->value.long_value;
     }
-    l_vector_push(&value.value.list, &expression);
-    return value;
+    return value->value.double_value;
 }
 
-l_value_t l_parse_atom(l_token_t *token, l_vector_t **string_table) {
-    switch(token->type) {
-        case TOKEN_REAL: {
-            l_value_t value = {.type = L_VALUE_NUMBER, .value.double_value = token->value.real, .flags = L_VALUE_FLAG_REAL};
-            return value;
+// Arithmetic stays on long long while every argument is an integer and no
+// step overflows or leaves a remainder; the first argument failing that guard
+// moves the rest of the fold to doubles.
+l_value_t l_builtin_arithmetic(l_interpreter_t *interpreter, l_builtin_t builtin, l_value_t *args, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+        if(args[i].type != L_VALUE_NUMBER) {
+            return l_value_error(&interpreter->string_table, "Arithmetic on non-number argument %zu of type %d", i, args[i].type);
         }
-        case TOKEN_INTEGER: {
-            l_value_t value = {.type = L_VALUE_NUMBER, .value.long_value = token->value.number, .flags = L_VALUE_FLAG_INTEGER};
-            return value;
+    }
+    if(count == 0) {
+        if(builtin == L_BUILTIN_ADD) return l_value_integer(0);
+        if(builtin == L_BUILTIN_MUL) return l_value_integer(1);
+        return l_value_error(&interpreter->string_table, "Arithmetic builtin %d expects at least 1 argument", builtin);
+    }
+
+    // (- x) and (/ x) fold from the identity element instead of the first argument
+    bool unary = count == 1 && (builtin == L_BUILTIN_SUB || builtin == L_BUILTIN_DIV);
+    size_t i = unary ? 0 : 1;
+    long long integer = unary ? (builtin == L_BUILTIN_SUB ? 0 : 1) : args[0].value.long_value;
+    double real = 0.0;
+    bool is_integer = unary || (args[0].flags & L_VALUE_FLAG_INTEGER);
+    if(!is_integer) {
+        real = args[0].value.double_value;
+    }
+
+    for(; is_integer && i < count; i++) {
+        if(!(args[i].flags & L_VALUE_FLAG_INTEGER)) {
+            break;
         }
-        case TOKEN_STRING: {
-            l_value_t value = {.type = L_VALUE_STRING, .value.string_index = l_intern_string(string_table, token->value.string, false)};
-            return value;
+        long long operand = args[i].value.long_value;
+        long long next = 0;
+        bool overflow = false;
+        switch(builtin) {
+            case L_BUILTIN_ADD: overflow = __builtin_add_overflow(integer, operand, &next); break;
+            case L_BUILTIN_SUB: overflow = __builtin_sub_overflow(integer, operand, &next); break;
+            case L_BUILTIN_MUL: overflow = __builtin_mul_overflow(integer, operand, &next); break;
+            case L_BUILTIN_DIV:
+                if(operand == 0) {
+                    return l_value_error(&interpreter->string_table, "Integer division by zero");
+                }
+                overflow = (operand == -1 && integer == LLONG_MIN) || integer % operand != 0;
+                next = overflow ? 0 : integer / operand;
+                break;
+            default: break;
         }
-        case TOKEN_BOOLEAN: {
-            l_value_t value = {.type = L_VALUE_BOOL, .value.boolean = token->value.boolean};
-            return value;
+        if(overflow) {
+            break;
         }
-        case TOKEN_CHARACTER: {
-            l_value_t value = {.type = L_VALUE_CHARACTER, .value.character = token->value.character};
-            return value;
+        integer = next;
+    }
+    if(is_integer && i == count) {
+        return l_value_integer(integer);
+    }
+    if(is_integer) {
+        real = (double)integer;
+    }
+
+    for(; i < count; i++) {
+        double operand = l_number_as_double(&args[i]);
+        switch(builtin) {
+            case L_BUILTIN_ADD: real += operand; break;
+            case L_BUILTIN_SUB: real -= operand; break;
+            case L_BUILTIN_MUL: real *= operand; break;
+            case L_BUILTIN_DIV: real /= operand; break;
+            default: break;
         }
-        case TOKEN_SYMBOL: {
-            l_value_t value = {.type = L_VALUE_SYMBOL, .value.symbol_index = l_intern_string(string_table, token->value.symbol, false)};
-            return value;
+    }
+    return l_value_real(real);
+}
+
+l_value_t l_builtin_compare(l_interpreter_t *interpreter, l_builtin_t builtin, l_value_t *args, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+        if(args[i].type != L_VALUE_NUMBER) {
+            return l_value_error(&interpreter->string_table, "Comparison of non-number argument %zu of type %d", i, args[i].type);
         }
-        default: {
-            char *error_message;
-            asprintf(&error_message, "Error: Cannot convert token to value, type=%d\n", token->type);
-            l_value_t value = {.type = L_VALUE_ERROR, .value.string_index = l_intern_string(string_table, error_message, false)};
-            return value;
+    }
+    for(size_t i = 1; i < count; i++) {
+        int order;
+        if((args[i - 1].flags & L_VALUE_FLAG_INTEGER) && (args[i].flags & L_VALUE_FLAG_INTEGER)) {
+            long long a = args[i - 1].value.long_value, b = args[i].value.long_value;
+            order = (a > b) - (a < b);
+        } else {
+            double a = l_number_as_double(&args[i - 1]), b = l_number_as_double(&args[i]);
+            if(a != a || b != b) {
+                return l_value_bool(false);
+            }
+            order = (a > b) - (a < b);
+        }
+        bool holds = builtin == L_BUILTIN_LT ? order < 0
+                   : builtin == L_BUILTIN_GT ? order > 0
+                   : order == 0;
+        if(!holds) {
+            return l_value_bool(false);
         }
-
     }
+    return l_value_bool(true);
 }
 
-size_t l_intern_string(l_vector_t **string_table, const char *string, bool eternal) {
-    for(size_t i = 0; i < (*string_table)->length; i++) {
-        l_ref_counted_t *ref_counted = (l_ref_counted_t *)l_vector_get(*string_table, i);
-        if(strcmp((char *)ref_counted->data, string) == 0) {
-            ref_counted->ref_count++;
-            return i;
-        }
+static l_value_t *l_collection_lookup(l_value_t *collection, l_value_t *key) {
+    bool integer_key = key->type == L_VALUE_NUMBER && (key->flags & L_VALUE_FLAG_INTEGER) && key->value.long_value >= 0;
+    switch(collection->type) {
+        case L_VALUE_MAP:
+            return l_hash_map_get(collection->value.map, key);
+        case L_VALUE_VECTOR:
+            return integer_key ? l_pvector_get(collection->value.vector, (size_t)key->value.long_value) : NULL;
+        case L_VALUE_LIST:
+            return integer_key ? (l_value_t *)l_vector_get(&collection->value.list, (size_t)key->value.long_value) : NULL;
+        default:
+            return NULL;
     }
-    l_ref_counted_t ref_counted;
-    l_ref_counted_init(&ref_counted, (void*)string, eternal ? NULL : (void (*)(void *))free);
+}
+
+// Consumes collection, key and value. nil acts as an empty map.
+static l_value_t l_collection_assoc(l_interpreter_t *interpreter, l_value_t collection, l_value_t key, l_value_t value) {
+    if(collection.type == L_VALUE_NIL) {
+        collection = (l_value_t) {.type = L_VALUE_MAP, .value.map = l_hash_map_create()};
+    }
+    if(collection.type == L_VALUE_MAP) {
+        collection.value.map = l_hash_map_assoc(collection.value.map, key, value);
+        return collection;
+    }
+    l_value_t error;
+    if(collection.type != L_VALUE_VECTOR) {
+        error = l_value_error(&interpreter->string_table, "Cannot assoc on a value of type %d", collection.type);
+    } else if(key.type != L_VALUE_NUMBER || !(key.flags & L_VALUE_FLAG_INTEGER)) {
+        error = l_value_error(&interpreter->string_table, "Vector index must be an integer, got type %d", key.type);
+    } else if(key.value.long_value < 0 || (size_t)key.value.long_value > collection.value.vector->count) {
+        error = l_value_error(&interpreter->string_table, "Vector index %lld out of bounds for count %zu",
+                key.value.long_value, collection.value.vector->count);
+    } else {
+        collection.value.vector = l_pvector_assoc(collection.value.vector, (size_t)key.value.long_value, value);
+        return collection;
+    }
+    l_value_destroy(&collection);
+    l_value_destroy(&key);
+    l_value_destroy(&value);
+    return error;
+}
+
+// Consumes collection and element. Maps take [key value] vectors.
+static l_value_t l_collection_conj(l_interpreter_t *interpreter, l_value_t collection, l_value_t element) {
+    if(collection.type == L_VALUE_NIL) {
+        collection = (l_value_t) {.type = L_VALUE_VECTOR, .value.vector = l_pvector_create()};
+    }
+    if(collection.type == L_VALUE_VECTOR) {
+        collection.value.vector = l_pvector_conj(collection.value.vector, element);
+        return collection;
+    }
+    if(collection.type == L_VALUE_MAP && element.type == L_VALUE_VECTOR && element.value.vector->count == 2) {
+        l_value_t key = l_value_copy(l_pvector_get(element.value.vector, 0));
+        l_value_t value = l_value_copy(l_pvector_get(element.value.vector, 1));
+        l_value_destroy(&element);
+        return l_collection_assoc(interpreter, collection, key, value);
+    }
+    l_value_t error = collection.type == L_VALUE_MAP
+        ? l_value_error(&interpreter->string_table, "conj on a map expects [key value] vectors, got type %d", element.type)
+        : l_value_error(&interpreter->string_table, "Cannot conj on a value of type %d", collection.type);
+    l_value_destroy(&collection);
+    l_value_destroy(&element);
+    return error;
+}
+
+l_value_t l_builtin_collection(l_interpreter_t *interpreter, l_builtin_t builtin, l_value_t *args, size_t count) {
+    switch(builtin) {
+        case L_BUILTIN_VECTOR: {
+            l_pvector_t *vector = l_pvector_create();
+            for(size_t i = 0; i < count; i++) {
+                vector = l_pvector_conj(vector, args[i]);
+                args[i] = l_value_nil();
+            }
+            return (l_value_t) {.type = L_VALUE_VECTOR, .value.vector = vector};
+        }
+        case L_BUILTIN_HASH_MAP: {
+            if(count % 2 != 0) {
+                return l_value_error(&interpreter->string_table, "hash-map expects an even number of arguments, got %zu", count);
+            }
+            l_hash_map_t *map = l_hash_map_create();
+            for(size_t i = 0; i < count; i += 2) {
+                map = l_hash_map_assoc(map, args[i], args[i + 1]);
+                args[i] = l_value_nil();
+                args[i + 1] = l_value_nil();
+            }
+            return (l_value_t) {.type = L_VALUE_MAP, .value.map = map};
+        }
+        case L_BUILTIN_COUNT: {
+            if(count != 1) {
+                return l_value_error(&interpreter->string_table, "count expects 1 argument, got %zu", count);
+            }
+            switch(args[0].type) {
+                case L_VALUE_NIL: return l_value_integer(0);
+                case L_VALUE_LIST: return l_value_integer((long long)args[0].value.list.length);
+                case L_VALUE_VECTOR: return l_value_integer((long long)args[0].value.vector->count);
+                case L_VALUE_MAP: return l_value_integer((long long)args[0].value.map->count);
+                default:
+                    return l_value_error(&interpreter->string_table, "Cannot count a value of type %d", args[0].type);
+            }
+        }
+        case L_BUILTIN_GET: {
+            if(count != 2 && count != 3) {
+                return l_value_error(&interpreter->string_table, "get expects 2 or 3 arguments, got %zu", count);
+            }
+            l_value_t *found = l_collection_lookup(&args[0], &args[1]);
+            if(found != NULL) {
+                return l_value_copy(found);
+            }
+            return count == 3 ? l_value_copy(&args[2]) : l_value_nil();
+        }
+        case L_BUILTIN_ASSOC: {
+            if(count < 3 || count % 2 == 0) {
+                return l_value_error(&interpreter->string_table, "assoc expects a collection and key value pairs, got %zu arguments", count);
+            }
+            l_value_t collection = args[0];
+            args[0] = l_value_nil();
+            for(size_t i = 1; i < count && collection.type != L_VALUE_ERROR; i += 2) {
+                collection = l_collection_assoc(interpreter, collection, args[i], args[i + 1]);
+                args[i] = l_value_nil();
+                args[i + 1] = l_value_nil();
+            }
+            return collection;
+        }
+        case L_BUILTIN_CONJ: {
+            if(count < 1) {
+                return l_value_error(&interpreter->string_table, "conj expects at least 1 argument");
+            }
+            l_value_t collection = args[0];
+            args[0] = l_value_nil();
+            for(size_t i = 1; i < count && collection.type != L_VALUE_ERROR; i++) {
+                collection = l_collection_conj(interpreter, collection, args[i]);
+                args[i] = l_value_nil();
+            }
+            return collection;
+        }
+        case L_BUILTIN_UPDATE: {
+            // (update coll key 'f args...) assocs (f (get coll key) args...), f names a builtin
+            if(count < 3) {
+                return l_value_error(&interpreter->string_table, "update expects at least 3 arguments, got %zu", count);
+            }
+            l_builtin_t function = args[2].type == L_VALUE_SYMBOL
+                ? l_interpreter_lookup_builtin(interpreter, args[2].value.symbol_index) : L_BUILTIN_NONE;
+            if(function == L_BUILTIN_NONE || function == L_BUILTIN_QUOTE || function == L_BUILTIN_SPAWN
+                    || function == L_BUILTIN_MEMOIZE) {
+                return l_value_error(&interpreter->string_table, "update expects the name of a builtin function");
+            }
+            size_t call_count = count - 2;
+            l_value_t small_args[8];
+            l_value_t *call_args = call_count <= 8 ? small_args : (l_value_t *)malloc(sizeof(l_value_t) * call_count);
+            l_value_t *old = l_collection_lookup(&args[0], &args[1]);
+            call_args[0] = old != NULL ? l_value_copy(old) : l_value_nil();
+            for(size_t i = 1; i < call_count; i++) {
+                call_args[i] = l_value_copy(&args[i + 2]);
+            }
+            l_value_t value = l_builtin_call(interpreter, function, call_args, call_count);
+            for(size_t i = 0; i < call_count; i++) {
+                l_value_destroy(&call_args[i]);
+            }
+            if(call_args != small_args) {
+                free(call_args);
+            }
+            if(value.type == L_VALUE_ERROR) {
+                return value;
+            }
+            l_value_t collection = args[0];
+            l_value_t key = args[1];
+            args[0] = l_value_nil();
+            args[1] = l_value_nil();
+            return l_collection_assoc(interpreter, collection, key, value);
+        }
+        default:
+            return l_value_error(&interpreter->string_table, "Builtin %d is not a collection builtin", builtin);
+    }
+}
+
+static bool l_string_index_argument(l_value_t *value, size_t limit, size_t *index) {
+    if(value->type != L_VALUE_NUMBER || !(value->flags & L_VALUE_FLAG_INTEGER)
+            || value->value.long_value < 0 || (size_t)value->value.long_value > limit) {
+        return false;
+    }
+    *index = (size_t)value->value.long_value;
+    return true;
+}
+
+l_value_t l_builtin_string(l_interpreter_t *interpreter, l_builtin_t builtin, l_value_t *args, size_t count) {
+    if(builtin == L_BUILTIN_STR) {
+        // strings are joined without copying, everything else as it prints
+        l_rope_t *rope = l_rope_from_string("", 0);
+        for(size_t i = 0; i < count; i++) {
+            l_rope_t *piece;
+            if(args[i].type == L_VALUE_STRING) {
+                piece = args[i].value.rope;
+                args[i] = l_value_nil();
+            } else if(args[i].type == L_VALUE_CHARACTER) {
+                piece = l_rope_from_string(&args[i].value.character, 1);
+            } else if(args[i].type == L_VALUE_NIL) {
+                continue;
+            } else {
+                char *printed;
+                size_t printed_size;
+                FILE *out = open_memstream(&printed, &printed_size);
+                l_fprint_value(out, &args[i], interpreter->string_table);
+                fclose(out);
+                piece = l_rope_from_buffer(printed, printed_size);
+            }
+            rope = l_rope_concat(rope, piece);
+        }
+        return (l_value_t) {.type = L_VALUE_STRING, .value.rope = rope};
+    }
+
+    if(count == 0 || args[0].type != L_VALUE_STRING) {
+        return l_value_error(&interpreter->string_table, "String builtin %d expects a string as its first argument", builtin);
+    }
+    l_rope_t *rope = args[0].value.rope;
+    switch(builtin) {
+        case L_BUILTIN_STRING_LENGTH:
+            if(count != 1) {
+                return l_value_error(&interpreter->string_table, "string-length expects 1 argument, got %zu", count);
+            }
+            return l_value_integer((long long)rope->length);
+        case L_BUILTIN_STRING_REF: {
+            size_t index;
+            if(count != 2) {
+                return l_value_error(&interpreter->string_table, "string-ref expects 2 arguments, got %zu", count);
+            }
+            if(rope->length == 0 || !l_string_index_argument(&args[1], rope->length - 1, &index)) {
+                return l_value_error(&interpreter->string_table, "string-ref index out of bounds for length %zu", rope->length);
+            }
+            return l_value_character(l_rope_char_at(rope, index));
+        }
+        case L_BUILTIN_SUBSTRING: {
+            size_t start, end = rope->length;
+            if(count != 2 && count != 3) {
+                return l_value_error(&interpreter->string_table, "substring expects 2 or 3 arguments, got %zu", count);
+            }
+            if(!l_string_index_argument(&args[1], rope->length, &start)
+                    || (count == 3 && !l_string_index_argument(&args[2], rope->length, &end)) || start > end) {
+                return l_value_error(&interpreter->string_table, "substring bounds out of range for length %zu", rope->length);
+            }
+            return (l_value_t) {.type = L_VALUE_STRING, .value.rope = l_rope_slice(rope, start, end)};
+        }
+        case L_BUILTIN_INTERN: {
+            if(count != 1) {
+                return l_value_error(&interpreter->string_table, "intern expects 1 argument, got %zu", count);
+            }
+            char *name = strdup(l_rope_flatten(rope));
+            size_t index = l_intern_string(&interpreter->string_table, name, false);
+            if(l_get_interned_string(interpreter->string_table, index) != name) {
+                free(name); // already interned
+            }
+            return (l_value_t) {.type = L_VALUE_SYMBOL, .value.symbol_index = index};
+        }
+        default:
+            return l_value_error(&interpreter->string_table, "Builtin %d is not a string builtin", builtin);
+    }
+}
+
+// Set right before switching to a task, so that a task starting for the
+// first time can find itself; makecontext only passes int arguments.
+static l_task_t *l_task_starting = NULL;
+
+static l_scheduler_t *l_interpreter_scheduler(l_interpreter_t *interpreter) {
+    if(interpreter->scheduler == NULL) {
+        l_scheduler_t *scheduler = (l_scheduler_t *)calloc(1, sizeof(l_scheduler_t));
+        scheduler->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        l_vector_init(&scheduler->timers, sizeof(l_timer_t), 16, NULL);
+        l_vector_init(&scheduler->watches, sizeof(l_io_watch_t), 16, NULL);
+        interpreter->scheduler = scheduler;
+    }
+    return interpreter->scheduler;
+}
+
+static void l_scheduler_push_ready(l_scheduler_t *scheduler, l_task_t *task) {
+    task->next = NULL;
+    if(scheduler->ready_tail != NULL) {
+        scheduler->ready_tail->next = task;
+    } else {
+        scheduler->ready_head = task;
+    }
+    scheduler->ready_tail = task;
+}
+
+static l_task_t *l_scheduler_pop_ready(l_scheduler_t *scheduler) {
+    l_task_t *task = scheduler->ready_head;
+    if(task != NULL) {
+        scheduler->ready_head = task->next;
+        if(scheduler->ready_head == NULL) {
+            scheduler->ready_tail = NULL;
+        }
+        task->next = NULL;
+    }
+    return task;
+}
+
+void l_task_release(l_task_t *task) {
+    if(--task->ref_count > 0) {
+        return;
+    }
+    l_value_destroy(&task->expression);
+    l_value_destroy(&task->result);
+    munmap(task->stack, L_TASK_STACK_SIZE + (size_t)sysconf(_SC_PAGESIZE));
+    free(task);
+}
+
+static void l_task_entry(void) {
+    l_task_t *task = l_task_starting;
+    task->result = l_interpreter_execute(task->interpreter, task->expression);
+    task->done = true;
+    l_scheduler_t *scheduler = task->interpreter->scheduler;
+    while(task->waiters != NULL) {
+        l_task_t *waiter = task->waiters;
+        task->waiters = waiter->next;
+        l_scheduler_push_ready(scheduler, waiter);
+    }
+    // returning resumes uc_link, the scheduler loop on the main context
+}
+
+// Switches from the current task back to the scheduler loop; the task must
+// already be queued somewhere that will make it ready again.
+static void l_task_suspend(l_scheduler_t *scheduler) {
+    swapcontext(&scheduler->current->context, &scheduler->main_context);
+}
+
+static long long l_monotonic_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void l_timer_push(l_scheduler_t *scheduler, l_timer_t timer) {
+    l_vector_push(&scheduler->timers, &timer);
+    l_timer_t *heap = (l_timer_t *)scheduler->timers.data;
+    for(size_t i = scheduler->timers.length - 1; i > 0 && heap[(i - 1) / 2].deadline > heap[i].deadline; i = (i - 1) / 2) {
+        l_timer_t parent = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = heap[i];
+        heap[i] = parent;
+    }
+}
+
+static l_timer_t l_timer_pop(l_scheduler_t *scheduler) {
+    l_timer_t *heap = (l_timer_t *)scheduler->timers.data;
+    l_timer_t first = heap[0];
+    size_t length = --scheduler->timers.length;
+    heap[0] = heap[length];
+    for(size_t i = 0;;) {
+        size_t smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+        if(left < length && heap[left].deadline < heap[smallest].deadline) {
+            smallest = left;
+        }
+        if(right < length && heap[right].deadline < heap[smallest].deadline) {
+            smallest = right;
+        }
+        if(smallest == i) {
+            break;
+        }
+        l_timer_t swap = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = swap;
+        i = smallest;
+    }
+    return first;
+}
+
+static void l_scheduler_wake(l_scheduler_t *scheduler, l_task_t *task) {
+    if(task == NULL) {
+        scheduler->main_woken = true;
+    } else {
+        l_scheduler_push_ready(scheduler, task);
+    }
+}
+
+static l_io_watch_t *l_io_watch(l_scheduler_t *scheduler, int fd) {
+    while(scheduler->watches.length <= (size_t)fd) {
+        l_io_watch_t unwatched = {0};
+        l_vector_push(&scheduler->watches, &unwatched);
+    }
+    return (l_io_watch_t *)l_vector_get(&scheduler->watches, (size_t)fd);
+}
+
+// Makes fd's registration ask for exactly what its waiters still want.
+static int l_io_update(l_scheduler_t *scheduler, int fd, l_io_watch_t *watch) {
+    uint32_t events = (watch->readers != NULL || watch->main_reads ? EPOLLIN : 0)
+                    | (watch->writers != NULL || watch->main_writes ? EPOLLOUT : 0);
+    if(events == watch->events) {
+        return 0;
+    }
+    struct epoll_event event = {.events = events, .data.fd = fd};
+    int operation = watch->events == 0 ? EPOLL_CTL_ADD : events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    if(epoll_ctl(scheduler->epoll_fd, operation, fd, &event) != 0 && operation != EPOLL_CTL_DEL) {
+        return -1;
+    }
+    // every waiter wakes when fd turns ready, and all but the first may
+    // find nothing left; they must see EAGAIN rather than block the process
+    int flags;
+    if(operation == EPOLL_CTL_ADD && (flags = fcntl(fd, F_GETFL)) >= 0 && !(flags & O_NONBLOCK)
+            && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0) {
+        watch->made_nonblocking = true;
+    }
+    watch->events = events;
+    return 0;
+}
+
+static void l_io_wake_all(l_scheduler_t *scheduler, l_task_t **tasks, bool *main_waits) {
+    while(*tasks != NULL) {
+        l_task_t *task = *tasks;
+        *tasks = task->next;
+        scheduler->waiting--;
+        l_scheduler_push_ready(scheduler, task);
+    }
+    if(*main_waits) {
+        *main_waits = false;
+        scheduler->waiting--;
+        scheduler->main_woken = true;
+    }
+}
+
+// Wakes whoever waits on fd for the events that arrived, or everyone when
+// fd is about to be closed.
+static void l_io_wake(l_scheduler_t *scheduler, int fd, uint32_t events) {
+    l_io_watch_t *watch = l_io_watch(scheduler, fd);
+    if(events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        l_io_wake_all(scheduler, &watch->readers, &watch->main_reads);
+    }
+    if(events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+        l_io_wake_all(scheduler, &watch->writers, &watch->main_writes);
+    }
+    l_io_update(scheduler, fd, watch);
+}
+
+// Runs task on the main context until it suspends or finishes.
+static void l_scheduler_resume(l_scheduler_t *scheduler, l_task_t *task) {
+    scheduler->current = task;
+    l_task_starting = task;
+    swapcontext(&scheduler->main_context, &task->context);
+    scheduler->current = NULL;
+    if(!task->done) {
+        return;
+    }
+    // the task has left its stack, drop the scheduler's reference
+    if(task->live_prev != NULL) {
+        task->live_prev->live_next = task->live_next;
+    } else {
+        scheduler->live = task->live_next;
+    }
+    if(task->live_next != NULL) {
+        task->live_next->live_prev = task->live_prev;
+    }
+    l_task_release(task);
+}
+
+// Runs ready tasks, expired timers and epoll events on the main context until
+// `until` is done, or, without a task, until an event for the main context
+// arrives. Returns false if that can never happen.
+static bool l_scheduler_run(l_interpreter_t *interpreter, l_task_t *until) {
+    l_scheduler_t *scheduler = interpreter->scheduler;
+    while(until != NULL ? !until->done : !scheduler->main_woken) {
+        l_task_t *task = l_scheduler_pop_ready(scheduler);
+        if(task != NULL) {
+            l_scheduler_resume(scheduler, task);
+            continue;
+        }
+        if(scheduler->waiting == 0 && scheduler->timers.length == 0) {
+            return false;
+        }
+        int timeout = -1;
+        if(scheduler->timers.length > 0) {
+            long long remaining = ((l_timer_t *)scheduler->timers.data)[0].deadline - l_monotonic_now();
+            // round up, waking early would only spin
+            timeout = remaining > 0 ? (int)((remaining + 999999) / 1000000) : 0;
+        }
+        struct epoll_event events[64];
+        int count = epoll_wait(scheduler->epoll_fd, events, 64, timeout);
+        if(count < 0 && errno != EINTR) {
+            return false;
+        }
+        for(int i = 0; i < count; i++) {
+            l_io_wake(scheduler, events[i].data.fd, events[i].events);
+        }
+        long long now = l_monotonic_now();
+        while(scheduler->timers.length > 0 && ((l_timer_t *)scheduler->timers.data)[0].deadline <= now) {
+            l_scheduler_wake(scheduler, l_timer_pop(scheduler).task);
+        }
+    }
+    return true;
+}
+
+// Runs tasks that nothing awaited until every task has finished or none can
+// make progress, so a script's tasks complete before the interpreter goes
+// away. A task waiting on a peer that never comes keeps this waiting too.
+void l_interpreter_drain(l_interpreter_t *interpreter) {
+    l_scheduler_t *scheduler = interpreter->scheduler;
+    while(scheduler != NULL && scheduler->live != NULL) {
+        // finishing drops the scheduler's reference, keep the task alive to check it
+        l_task_t *task = scheduler->live;
+        task->ref_count++;
+        bool progress = l_scheduler_run(interpreter, task);
+        l_task_release(task);
+        if(!progress) {
+            break;
+        }
+    }
+}
+
+void l_scheduler_destroy(l_scheduler_t *scheduler) {
+    // tasks that never finished are abandoned, along with what their stacks hold
+    while(scheduler->live != NULL) {
+        l_task_t *task = scheduler->live;
+        scheduler->live = task->live_next;
+        task->done = true;
+        l_task_release(task);
+    }
+    // inherited descriptors outlive the interpreter, hand them back as found
+    for(size_t fd = 0; fd < scheduler->watches.length; fd++) {
+        l_io_watch_t *watch = (l_io_watch_t *)l_vector_get(&scheduler->watches, fd);
+        int flags;
+        if(watch->made_nonblocking && (flags = fcntl((int)fd, F_GETFL)) >= 0) {
+            fcntl((int)fd, F_SETFL, flags & ~O_NONBLOCK);
+        }
+    }
+    close(scheduler->epoll_fd);
+    l_vector_destroy(&scheduler->timers);
+    l_vector_destroy(&scheduler->watches);
+    free(scheduler);
+}
+
+l_value_t l_task_spawn(l_interpreter_t *interpreter, l_value_t *expression) {
+    l_scheduler_t *scheduler = l_interpreter_scheduler(interpreter);
+    // the guard page below the stack makes an overflow fault instead of
+    // overwriting whatever the heap put next to it
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    void *stack = mmap(NULL, L_TASK_STACK_SIZE + page, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if(stack == MAP_FAILED || mprotect(stack, page, PROT_NONE) != 0) {
+        if(stack != MAP_FAILED) {
+            munmap(stack, L_TASK_STACK_SIZE + page);
+        }
+        return l_value_error(&interpreter->string_table, "spawn failed: %s", strerror(errno));
+    }
+    l_task_t *task = (l_task_t *)calloc(1, sizeof(l_task_t));
+    task->ref_count = 2; // the returned value and the scheduler, until the task is done
+    task->interpreter = interpreter;
+    task->expression = l_value_copy(expression);
+    task->result = l_value_nil();
+    task->stack = stack;
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = (char *)stack + page;
+    task->context.uc_stack.ss_size = L_TASK_STACK_SIZE;
+    task->context.uc_link = &scheduler->main_context;
+    makecontext(&task->context, l_task_entry, 0);
+
+    task->live_next = scheduler->live;
+    if(scheduler->live != NULL) {
+        scheduler->live->live_prev = task;
+    }
+    scheduler->live = task;
+    l_scheduler_push_ready(scheduler, task);
+    return (l_value_t) {.type = L_VALUE_TASK, .value.task = task};
+}
+
+// Blocks the caller until fd is ready for EPOLLIN or EPOLLOUT: a task is
+// suspended, the main context runs the scheduler meanwhile. Any number of
+// tasks may wait on the same descriptor. Regular files, which epoll
+// rejects, count as always ready.
+static int l_io_wait(l_interpreter_t *interpreter, int fd, uint32_t events) {
+    if(fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    l_scheduler_t *scheduler = l_interpreter_scheduler(interpreter);
+    l_io_watch_t *watch = l_io_watch(scheduler, fd);
+    l_task_t *task = scheduler->current;
+    bool *main_waits = events == EPOLLIN ? &watch->main_reads : &watch->main_writes;
+    // waiters are appended, so they wake in the order they arrived
+    l_task_t **tail = events == EPOLLIN ? &watch->readers : &watch->writers;
+    while(*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    if(task != NULL) {
+        task->next = NULL;
+        *tail = task;
+    } else {
+        *main_waits = true;
+    }
+    if(l_io_update(scheduler, fd, watch) != 0) {
+        int error = errno;
+        if(task != NULL) {
+            *tail = NULL;
+        } else {
+            *main_waits = false;
+        }
+        errno = error;
+        return error == EPERM ? 0 : -1;
+    }
+    scheduler->waiting++;
+    if(task != NULL) {
+        l_task_suspend(scheduler);
+    } else {
+        scheduler->main_woken = false;
+        l_scheduler_run(interpreter, NULL);
+    }
+    return 0;
+}
+
+static bool l_async_integer_argument(l_value_t *args, size_t count, size_t index, long long *out) {
+    if(index >= count || args[index].type != L_VALUE_NUMBER || !(args[index].flags & L_VALUE_FLAG_INTEGER)) {
+        return false;
+    }
+    *out = args[index].value.long_value;
+    return true;
+}
+
+static bool l_async_string_argument(l_value_t *args, size_t count, size_t index, const char **out) {
+    if(index >= count || args[index].type != L_VALUE_STRING) {
+        return false;
+    }
+    *out = l_rope_flatten(args[index].value.rope);
+    return true;
+}
+
+static bool l_unix_address(const char *path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(address->sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+l_value_t l_builtin_async(l_interpreter_t *interpreter, l_builtin_t builtin, l_value_t *args, size_t count) {
+    l_scheduler_t *scheduler = l_interpreter_scheduler(interpreter);
+    long long fd = -1, number = 0;
+    const char *string = NULL;
+    switch(builtin) {
+        case L_BUILTIN_YIELD:
+            if(scheduler->current != NULL) {
+                l_scheduler_push_ready(scheduler, scheduler->current);
+                l_task_suspend(scheduler);
+            } else {
+                // on the main context, give every task that is ready one turn
+                l_task_t *last = scheduler->ready_tail;
+                l_task_t *task = NULL;
+                while(last != NULL && task != last && (task = l_scheduler_pop_ready(scheduler)) != NULL) {
+                    l_scheduler_resume(scheduler, task);
+                }
+            }
+            return l_value_nil();
+        case L_BUILTIN_AWAIT: {
+            if(count != 1 || args[0].type != L_VALUE_TASK) {
+                return l_value_error(&interpreter->string_table, "await expects a task");
+            }
+            l_task_t *task = args[0].value.task;
+            if(!task->done) {
+                if(scheduler->current == task) {
+                    return l_value_error(&interpreter->string_table, "A task cannot await itself");
+                }
+                if(scheduler->current != NULL) {
+                    scheduler->current->next = task->waiters;
+                    task->waiters = scheduler->current;
+                    l_task_suspend(scheduler);
+                } else if(!l_scheduler_run(interpreter, task)) {
+                    return l_value_error(&interpreter->string_table, "await would block forever, no task can make progress");
+                }
+            }
+            return l_value_copy(&task->result);
+        }
+        case L_BUILTIN_SLEEP: {
+            if(count != 1 || !l_async_integer_argument(args, count, 0, &number) || number < 0) {
+                return l_value_error(&interpreter->string_table, "sleep expects a non-negative number of milliseconds");
+            }
+            l_timer_push(scheduler, (l_timer_t) {.deadline = l_monotonic_now() + number * 1000000LL, .task = scheduler->current});
+            if(scheduler->current != NULL) {
+                l_task_suspend(scheduler);
+            } else {
+                scheduler->main_woken = false;
+                l_scheduler_run(interpreter, NULL);
+            }
+            return l_value_nil();
+        }
+        case L_BUILTIN_FD_READ: {
+            if(count != 2 || !l_async_integer_argument(args, count, 0, &fd) || !l_async_integer_argument(args, count, 1, &number) || number < 0) {
+                return l_value_error(&interpreter->string_table, "fd-read expects a file descriptor and a byte count");
+            }
+            char *buffer = (char *)malloc(number + 1);
+            ssize_t got;
+            do {
+                got = -1;
+                if(l_io_wait(interpreter, fd, EPOLLIN) != 0) {
+                    break;
+                }
+                got = read(fd, buffer, number);
+            } while(got < 0 && (errno == EAGAIN || errno == EINTR));
+            if(got < 0) {
+                free(buffer);
+                return l_value_error(&interpreter->string_table, "fd-read failed: %s", strerror(errno));
+            }
+            buffer[got] = '\0';
+            return (l_value_t) {.type = L_VALUE_STRING, .value.rope = l_rope_from_buffer(buffer, got)};
+        }
+        case L_BUILTIN_FD_WRITE: {
+            if(count != 2 || !l_async_integer_argument(args, count, 0, &fd) || !l_async_string_argument(args, count, 1, &string)) {
+                return l_value_error(&interpreter->string_table, "fd-write expects a file descriptor and a string");
+            }
+            size_t length = args[1].value.rope->length, written = 0;
+            while(written < length) {
+                if(l_io_wait(interpreter, fd, EPOLLOUT) != 0) {
+                    return l_value_error(&interpreter->string_table, "fd-write failed: %s", strerror(errno));
+                }
+                ssize_t put = write(fd, string + written, length - written);
+                if(put < 0 && errno != EAGAIN && errno != EINTR) {
+                    return l_value_error(&interpreter->string_table, "fd-write failed: %s", strerror(errno));
+                }
+                written += put > 0 ? (size_t)put : 0;
+            }
+            return l_value_integer((long long)written);
+        }
+        case L_BUILTIN_FD_CLOSE:
+            if(count != 1 || !l_async_integer_argument(args, count, 0, &fd)) {
+                return l_value_error(&interpreter->string_table, "fd-close expects a file descriptor");
+            }
+            // epoll forgets a closed descriptor on its own, so wake its waiters
+            // now; they see EBADF instead of sleeping forever
+            if(interpreter->scheduler != NULL && fd >= 0 && (size_t)fd < interpreter->scheduler->watches.length) {
+                l_io_wake(interpreter->scheduler, (int)fd, EPOLLIN | EPOLLOUT | EPOLLERR);
+                l_io_watch(interpreter->scheduler, (int)fd)->made_nonblocking = false;
+            }
+            if(close(fd) != 0) {
+                return l_value_error(&interpreter->string_table, "fd-close failed: %s", strerror(errno));
+            }
+            return l_value_nil();
+        case L_BUILTIN_FILE_OPEN: {
+            const char *mode = "r";
+            if((count != 1 && count != 2) || !l_async_string_argument(args, count, 0, &string)
+                    || (count == 2 && !l_async_string_argument(args, count, 1, &mode))) {
+                return l_value_error(&interpreter->string_table, "file-open expects a path and an optional mode");
+            }
+            int flags = strcmp(mode, "w") == 0 ? O_WRONLY | O_CREAT | O_TRUNC
+                      : strcmp(mode, "a") == 0 ? O_WRONLY | O_CREAT | O_APPEND
+                      : O_RDONLY;
+            // without O_NONBLOCK opening a FIFO waits for its other end
+            fd = open(string, flags | O_NONBLOCK | O_CLOEXEC, 0644);
+            if(fd < 0) {
+                return l_value_error(&interpreter->string_table, "file-open failed: %s", strerror(errno));
+            }
+            return l_value_integer(fd);
+        }
+        case L_BUILTIN_UNIX_CONNECT:
+        case L_BUILTIN_UNIX_LISTEN: {
+            struct sockaddr_un address;
+            if(count != 1 || !l_async_string_argument(args, count, 0, &string)) {
+                return l_value_error(&interpreter->string_table, "Unix socket builtin %d expects a path", builtin);
+            }
+            if(!l_unix_address(string, &address) || (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+                return l_value_error(&interpreter->string_table, "socket failed: %s", strerror(errno));
+            }
+            bool ok;
+            if(builtin == L_BUILTIN_UNIX_LISTEN) {
+                ok = bind(fd, (struct sockaddr *)&address, sizeof(address)) == 0 && listen(fd, SOMAXCONN) == 0;
+            } else {
+                ok = connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0;
+                if(!ok && errno == EINPROGRESS && l_io_wait(interpreter, fd, EPOLLOUT) == 0) {
+                    int error = 0;
+                    socklen_t length = sizeof(error);
+                    getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+                    errno = error;
+                    ok = error == 0;
+                }
+            }
+            if(!ok) {
+                int error = errno;
+                close(fd);
+                return l_value_error(&interpreter->string_table, "%s failed: %s",
+                        builtin == L_BUILTIN_UNIX_LISTEN ? "unix-listen" : "unix-connect", strerror(error));
+            }
+            return l_value_integer(fd);
+        }
+        case L_BUILTIN_UNIX_ACCEPT: {
+            if(count != 1 || !l_async_integer_argument(args, count, 0, &fd)) {
+                return l_value_error(&interpreter->string_table, "unix-accept expects a listening socket");
+            }
+            int client;
+            do {
+                client = -1;
+                if(l_io_wait(interpreter, fd, EPOLLIN) != 0) {
+                    break;
+                }
+                client = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            } while(client < 0 && (errno == EAGAIN || errno == EINTR));
+            if(client < 0) {
+                return l_value_error(&interpreter->string_table, "unix-accept failed: %s", strerror(errno));
+            }
+            return l_value_integer(client);
+        }
+        default:
+            return l_value_error(&interpreter->string_table, "Builtin %d is not an async builtin", builtin);
+    }
+}
+
+l_value_t l_builtin_stats(l_interpreter_t *interpreter, l_builtin_t builtin, l_value_t *args, size_t count) {
+    if(builtin == L_BUILTIN_MEMOIZE_LIMIT) {
+        if(count != 1 || args[0].type != L_VALUE_NUMBER || !(args[0].flags & L_VALUE_FLAG_INTEGER) || args[0].value.long_value < 0) {
+            return l_value_error(&interpreter->string_table, "memoize-limit expects a non-negative entry count, 0 for no limit");
+        }
+        long long previous = (long long)interpreter->memo.max_count;
+        l_table_set_limit(&interpreter->memo, (size_t)args[0].value.long_value);
+        return l_value_integer(previous);
+    }
+    if(count != 0) {
+        return l_value_error(&interpreter->string_table, "stats expects no arguments, got %zu", count);
+    }
+    struct {
+        const char *name;
+        size_t value;
+    } counters[] = {
+        {"memo-hits", interpreter->stats.memo_hits},
+        {"memo-misses", interpreter->stats.memo_misses},
+        {"memo-evictions", interpreter->memo.evictions},
+        {"memo-entries", interpreter->memo.count},
+        {"memo-limit", interpreter->memo.max_count},
+    };
+    l_hash_map_t *map = l_hash_map_create();
+    for(size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+        map = l_hash_map_assoc(map, l_value_string(counters[i].name), l_value_integer((long long)counters[i].value));
+    }
+    return (l_value_t) {.type = L_VALUE_MAP, .value.map = map};
+}
+
+#define L_EMIT_C_TEXT_CHUNK 512
+
+typedef struct lEmitter {
+    l_interpreter_t *interpreter;
+    FILE *out;
+    size_t temporaries;
+    bool jumps_to_done;
+} l_emitter_t;
+
+static void l_emit_c_string(FILE *out, const char *string) {
+    fputc('"', out);
+    for(const unsigned char *c = (const unsigned char *)string; *c != '\0'; c++) {
+        if(*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if(isprint(*c)) {
+            fputc(*c, out);
+        } else {
+            fprintf(out, "\\%03o", *c);
+        }
+    }
+    fputc('"', out);
+}
+
+static void l_emit_c_integer(FILE *out, long long number) {
+    if(number == LLONG_MIN) {
+        fprintf(out, "LLONG_MIN");
+    } else {
+        fprintf(out, "%lldLL", number);
+    }
+}
+
+static l_builtin_t l_emit_c_callee(l_emitter_t *emitter, l_value_t *expression) {
+    if(expression->type != L_VALUE_LIST || expression->value.list.length == 0) {
+        return L_BUILTIN_NONE;
+    }
+    l_value_t *head = (l_value_t *)l_vector_get(&expression->value.list, 0);
+    if(head->type != L_VALUE_SYMBOL) {
+        return L_BUILTIN_NONE;
+    }
+    return l_interpreter_lookup_builtin(emitter->interpreter, head->value.symbol_index);
+}
+
+// An arithmetic form whose first argument is a double never takes the integer
+// path, so its whole fold can be emitted as a plain C double expression.
+static bool l_emit_c_is_flonum(l_emitter_t *emitter, l_value_t *expression) {
+    if(expression->type == L_VALUE_NUMBER) {
+        return expression->flags & L_VALUE_FLAG_REAL;
+    }
+    l_builtin_t builtin = l_emit_c_callee(emitter, expression);
+    if(builtin != L_BUILTIN_ADD && builtin != L_BUILTIN_SUB && builtin != L_BUILTIN_MUL && builtin != L_BUILTIN_DIV) {
+        return false;
+    }
+    l_vector_t *list = &expression->value.list;
+    if(list->length < 2 || !l_emit_c_is_flonum(emitter, (l_value_t *)l_vector_get(list, 1))) {
+        return false;
+    }
+    for(size_t i = 2; i < list->length; i++) {
+        l_value_t *arg = (l_value_t *)l_vector_get(list, i);
+        bool integer_literal = arg->type == L_VALUE_NUMBER && (arg->flags & L_VALUE_FLAG_INTEGER);
+        if(!integer_literal && !l_emit_c_is_flonum(emitter, arg)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void l_emit_c_flonum(l_emitter_t *emitter, l_value_t *expression) {
+    FILE *out = emitter->out;
+    if(expression->type == L_VALUE_NUMBER) {
+        if(expression->flags & L_VALUE_FLAG_INTEGER) {
+            fprintf(out, "((double)");
+            l_emit_c_integer(out, expression->value.long_value);
+            fprintf(out, ")");
+        } else {
+            fprintf(out, "%a", expression->value.double_value);
+        }
+        return;
+    }
+    l_builtin_t builtin = l_emit_c_callee(emitter, expression);
+    const char *op = builtin == L_BUILTIN_ADD ? "+" : builtin == L_BUILTIN_SUB ? "-" : builtin == L_BUILTIN_MUL ? "*" : "/";
+    l_vector_t *list = &expression->value.list;
+    if(list->length == 2) {
+        // (- x) and (/ x) fold from the identity element, as in l_builtin_arithmetic
+        fprintf(out, "(%s %s ", builtin == L_BUILTIN_SUB ? "0.0" : "1.0", op);
+        l_emit_c_flonum(emitter, (l_value_t *)l_vector_get(list, 1));
+        fprintf(out, ")");
+        return;
+    }
+    for(size_t i = 2; i < list->length; i++) {
+        fprintf(out, "(");
+    }
+    l_emit_c_flonum(emitter, (l_value_t *)l_vector_get(list, 1));
+    for(size_t i = 2; i < list->length; i++) {
+        fprintf(out, " %s ", op);
+        l_emit_c_flonum(emitter, (l_value_t *)l_vector_get(list, i));
+        fprintf(out, ")");
+    }
+}
+
+static void l_emit_c_fail(l_emitter_t *emitter, size_t destination) {
+    fprintf(emitter->out, "    if(t[%zu].type == L_VALUE_ERROR) {\n        result = %zu;\n        goto done;\n    }\n",
+            destination, destination);
+    emitter->jumps_to_done = true;
+}
+
+static void l_emit_c_error(l_emitter_t *emitter, size_t destination, const char *fmt, const char *argument) {
+    fprintf(emitter->out, "    t[%zu] = l_value_error(&interpreter->string_table, ", destination);
+    l_emit_c_string(emitter->out, fmt);
+    fprintf(emitter->out, ", ");
+    l_emit_c_string(emitter->out, argument);
+    fprintf(emitter->out, ");\n");
+    l_emit_c_fail(emitter, destination);
+}
+
+static void l_emit_c_quoted(l_emitter_t *emitter, l_value_t *value, size_t destination) {
+    FILE *out = emitter->out;
+    l_vector_t *string_table = emitter->interpreter->string_table;
+    fprintf(out, "    t[%zu] = ", destination);
+    switch(value->type) {
+        case L_VALUE_NUMBER:
+            if(value->flags & L_VALUE_FLAG_INTEGER) {
+                fprintf(out, "l_value_integer(");
+                l_emit_c_integer(out, value->value.long_value);
+            } else {
+                fprintf(out, "l_value_real(%a", value->value.double_value);
+            }
+            fprintf(out, ");\n");
+            break;
+        case L_VALUE_STRING:
+            fprintf(out, "l_value_string(");
+            l_emit_c_string(out, l_rope_flatten(value->value.rope));
+            fprintf(out, ");\n");
+            break;
+        case L_VALUE_SYMBOL:
+            fprintf(out, "l_value_symbol(&interpreter->string_table, ");
+            l_emit_c_string(out, l_get_interned_string(string_table, value->value.symbol_index));
+            fprintf(out, ");\n");
+            break;
+        case L_VALUE_CHARACTER:
+            fprintf(out, "l_value_character((char)%d);\n", value->value.character);
+            break;
+        case L_VALUE_BOOL:
+            fprintf(out, "l_value_bool(%s);\n", value->value.boolean ? "true" : "false");
+            break;
+        case L_VALUE_NIL:
+        case L_VALUE_ERROR:
+        case L_VALUE_VECTOR:
+        case L_VALUE_MAP:
+        case L_VALUE_TASK:
+            // the reader never produces errors or collections, only their constructor forms
+            fprintf(out, "l_value_nil();\n");
+            break;
+        case L_VALUE_LIST: {
+            fprintf(out, "l_value_nil();\n");
+            size_t count = value->value.list.length;
+            size_t base = emitter->temporaries;
+            emitter->temporaries += count;
+            for(size_t i = 0; i < count; i++) {
+                l_emit_c_quoted(emitter, (l_value_t *)l_vector_get(&value->value.list, i), base + i);
+            }
+            fprintf(out, "    t[%zu] = l_value_list(&t[%zu], %zu);\n", destination, base, count);
+        } break;
+    }
+}
+
+// Emits statements that leave the value of expression in t[destination],
+// mirroring l_interpreter_execute: known builtins are called directly and the
+// first error jumps to the end of the form.
+static void l_emit_c_expression(l_emitter_t *emitter, l_value_t *expression, size_t destination) {
+    FILE *out = emitter->out;
+    l_vector_t *string_table = emitter->interpreter->string_table;
+    switch(expression->type) {
+        case L_VALUE_SYMBOL:
+            l_emit_c_error(emitter, destination, "Unbound symbol: %s",
+                    l_get_interned_string(string_table, expression->value.symbol_index));
+            return;
+        case L_VALUE_LIST:
+            break;
+        default:
+            l_emit_c_quoted(emitter, expression, destination);
+            return;
+    }
+
+    l_vector_t *list = &expression->value.list;
+    if(list->length == 0) {
+        fprintf(out, "    t[%zu] = l_value_nil();\n", destination);
+        return;
+    }
+    l_value_t *head = (l_value_t *)l_vector_get(list, 0);
+    if(head->type != L_VALUE_SYMBOL) {
+        char type[16];
+        snprintf(type, sizeof(type), "%d", head->type);
+        l_emit_c_error(emitter, destination, "Cannot call a value of type %s", type);
+        return;
+    }
+    l_builtin_t builtin = l_interpreter_lookup_builtin(emitter->interpreter, head->value.symbol_index);
+    if(builtin == L_BUILTIN_NONE) {
+        l_emit_c_error(emitter, destination, "Unknown function: %s",
+                l_get_interned_string(string_table, head->value.symbol_index));
+        return;
+    }
+    if(builtin == L_BUILTIN_QUOTE) {
+        if(list->length != 2) {
+            char count[32];
+            snprintf(count, sizeof(count), "%zu", list->length - 1);
+            l_emit_c_error(emitter, destination, "quote expects 1 argument, got %s", count);
+            return;
+        }
+        l_emit_c_quoted(emitter, (l_value_t *)l_vector_get(list, 1), destination);
+        return;
+    }
+    if(builtin == L_BUILTIN_SPAWN) {
+        // the spawned expression is rebuilt as data and run by the evaluator
+        if(list->length != 2) {
+            char count[32];
+            snprintf(count, sizeof(count), "%zu", list->length - 1);
+            l_emit_c_error(emitter, destination, "spawn expects 1 argument, got %s", count);
+            return;
+        }
+        size_t expression = emitter->temporaries++;
+        l_emit_c_quoted(emitter, (l_value_t *)l_vector_get(list, 1), expression);
+        fprintf(out, "    t[%zu] = l_task_spawn(interpreter, &t[%zu]);\n", destination, expression);
+        return;
+    }
+    if(builtin == L_BUILTIN_MEMOIZE) {
+        // the cache lives in the interpreter, so hand the whole form to it
+        size_t form = emitter->temporaries++;
+        l_emit_c_quoted(emitter, expression, form);
+        fprintf(out, "    t[%zu] = l_interpreter_execute(interpreter, t[%zu]);\n", destination, form);
+        l_emit_c_fail(emitter, destination);
+        return;
+    }
+    if(l_emit_c_is_flonum(emitter, expression)) {
+        fprintf(out, "    t[%zu] = l_value_real(", destination);
+        l_emit_c_flonum(emitter, expression);
+        fprintf(out, ");\n");
+        return;
+    }
+
+    size_t count = list->length - 1;
+    size_t base = emitter->temporaries;
+    emitter->temporaries += count;
+    for(size_t i = 0; i < count; i++) {
+        l_emit_c_expression(emitter, (l_value_t *)l_vector_get(list, i + 1), base + i);
+    }
+    // call the group function directly, skipping l_builtin_call's switch
+    static const char *builtin_callees[] = {
+#define L_BUILTIN_CALLEE(name, group) "l_builtin_" #group,
+        L_CALLABLE_BUILTINS(L_BUILTIN_CALLEE)
+#undef L_BUILTIN_CALLEE
+    };
+    static const char *builtin_constants[] = {
+#define L_BUILTIN_CONSTANT(name, group) "L_BUILTIN_" #name,
+        L_CALLABLE_BUILTINS(L_BUILTIN_CONSTANT)
+#undef L_BUILTIN_CONSTANT
+    };
+    fprintf(out, "    t[%zu] = %s(interpreter, %s, &t[%zu], %zu);\n",
+            destination, builtin_callees[builtin], builtin_constants[builtin], base, count);
+    l_emit_c_fail(emitter, destination);
+}
+
+// Translates every top level form of source into C that defines
+// l_script_run(interpreter), which prints the same "form => value" lines as
+// l_interpreter_eval without tokenizing or dispatching at run time. Built
+// as a shared object, it is run by the interpreter that loads it.
+int l_emit_c(l_interpreter_t *interpreter, const char *source, FILE *out) {
+    l_tokenizer_t tokenizer;
+    tokenizer.data = source;
+    tokenizer.offset = 0;
+    tokenizer.data_length = strlen(source);
+
+    fprintf(out, "#define L_INTERPRETER_DECLARATIONS_ONLY 1\n#include \"linterpreter.h\"\n\n");
+    fprintf(out, "void l_script_run(l_interpreter_t *interpreter);\n");
+    size_t forms = 0;
+    l_token_t first = l_tokenizer_next(&tokenizer);
+    while(first.type != TOKEN_EOF) {
+        l_value_t form = l_parse_expression(first, &tokenizer, &interpreter->string_table);
+        if(form.type == L_VALUE_ERROR) {
+            fprintf(stderr, "ERROR: %s\n", l_get_interned_string(interpreter->string_table, form.value.string_index));
+            return 1;
+        }
+
+        char *body;
+        size_t body_size;
+        FILE *body_out = open_memstream(&body, &body_size);
+        l_emitter_t emitter = {.interpreter = interpreter, .out = body_out, .temporaries = 1};
+        l_emit_c_expression(&emitter, &form, 0);
+        fclose(body_out);
+
+        char *text;
+        size_t text_size;
+        FILE *text_out = open_memstream(&text, &text_size);
+        l_fprint_value(text_out, &form, interpreter->string_table);
+        fprintf(text_out, " => ");
+        fclose(text_out);
+
+        fprintf(out, "\nstatic void l_form_%zu(l_interpreter_t *interpreter) {\n", forms);
+        fprintf(out, "    l_value_t t[%zu];\n    size_t result = 0;\n", emitter.temporaries);
+        fprintf(out, "    for(size_t i = 0; i < %zu; i++) {\n        t[i] = l_value_nil();\n    }\n", emitter.temporaries);
+        fputs(body, out);
+        if(emitter.jumps_to_done) {
+            fprintf(out, "done:\n");
+        }
+        // C99 only promises string literals up to 4095 characters, so long
+        // forms are echoed a piece at a time.
+        for(size_t offset = 0; offset < text_size; offset += L_EMIT_C_TEXT_CHUNK) {
+            size_t length = text_size - offset < L_EMIT_C_TEXT_CHUNK ? text_size - offset : L_EMIT_C_TEXT_CHUNK;
+            char saved = text[offset + length];
+            text[offset + length] = '\0';
+            fprintf(out, "    fputs(");
+            l_emit_c_string(out, text + offset);
+            fprintf(out, ", stdout);\n");
+            text[offset + length] = saved;
+        }
+        fprintf(out, "    l_debug_print_value(&t[result], interpreter->string_table);\n    printf(\"\\n\");\n    fflush(stdout);\n");
+        fprintf(out, "    for(size_t i = 0; i < %zu; i++) {\n        l_value_destroy(&t[i]);\n    }\n}\n", emitter.temporaries);
+
+        free(body);
+        free(text);
+        l_value_destroy(&form);
+        forms++;
+        first = l_tokenizer_next(&tokenizer);
+    }
+
+    fprintf(out, "\nvoid l_script_run(l_interpreter_t *interpreter) {\n");
+    for(size_t i = 0; i < forms; i++) {
+        fprintf(out, "    l_form_%zu(interpreter);\n", i);
+    }
+    fprintf(out, "    l_interpreter_drain(interpreter);\n}\n");
+    return 0;
+}
+
+l_value_t l_parse_expression(l_token_t first, l_tokenizer_t *tokenizer, l_vector_t **string_table) {
+    //l_token_t token = l_tokenizer_next(tokenizer);
+    const char *err_where = NULL;
+    const char *err_why = NULL;
+    switch(first.type) {
+        case TOKEN_LPAREN:
+            return l_parse_list(tokenizer, string_table);
+        case TOKEN_QUOTE:
+            return l_parse_quote(tokenizer, string_table);
+        case TOKEN_LBRACKET:
+            return l_parse_collection(tokenizer, string_table, "vector", TOKEN_RBRACKET);
+        case TOKEN_LBRACE:
+            return l_parse_collection(tokenizer, string_table, "hash-map", TOKEN_RBRACE);
+        case TOKEN_REAL:
+        case TOKEN_INTEGER:
+        case TOKEN_STRING:
+        case TOKEN_BOOLEAN:
+        case TOKEN_CHARACTER:
+        case TOKEN_SYMBOL:
+            return l_parse_atom(&first, string_table);
+        case TOKEN_ERROR:
+            err_where = "tokenization";
+            err_why = first.value.error_message;
+            break;
+        case TOKEN_EOF:
+            err_where = "parsing";
+            err_why = "unexpected end of file";
+            break;
+        case TOKEN_RPAREN:
+            err_where = "parsing";
+            err_why = "unexpected ')'";
+            break;
+        case TOKEN_RBRACKET:
+            err_where = "parsing";
+            err_why = "unexpected ']'";
+            break;
+        case TOKEN_RBRACE:
+            err_where = "parsing";
+            err_why = "unexpected '}'";
+            break;
+        default:
+            err_where = "parsing";
+            err_why = "unhandled token type";
+            break;
+    }
+    char *error_message;
+    asprintf(&error_message, "Error while parsing token type %d: where: %s why: %s", first.type, err_where, err_why);
+    size_t interned_index = l_intern_string(string_table, error_message, false);
+    return (l_value_t) {.type = L_VALUE_ERROR, .value.string_index = interned_index};
+}
+
+l_interpreter_t* l_interpreter_create() {
+    l_interpreter_t* interpreter = (l_interpreter_t*)malloc(sizeof(l_interpreter_t));
+    interpreter->string_table = (l_vector_t*)malloc(sizeof(l_vector_t));
+    l_vector_init(interpreter->string_table, sizeof(l_ref_counted_t), 16, (void (*)(void *))l_ref_counted_destroy);
+    for(size_t i = 0; i < L_BUILTIN_NAME_COUNT; i++) {
+        interpreter->builtin_symbols[i] = l_intern_string(&interpreter->string_table, l_builtin_names[i].name, true);
+    }
+    interpreter->scheduler = NULL;
+    interpreter->depth = 0;
+    l_table_init(&interpreter->memo, 16);
+    l_table_set_limit(&interpreter->memo, L_MEMO_DEFAULT_LIMIT);
+    interpreter->stats = (l_interpreter_stats_t) {0};
+    return interpreter;
+}
+
+void l_interpreter_destroy(l_interpreter_t* interpreter) {
+    if(interpreter->scheduler != NULL) {
+        l_scheduler_destroy(interpreter->scheduler);
+    }
+    l_table_destroy(&interpreter->memo);
+    l_vector_destroy(interpreter->string_table);
+    free(interpreter->string_table);
+    free(interpreter);
+}
+
+void l_value_destroy(l_value_t *value) {
+    switch(value->type) {
+        case L_VALUE_NIL:
+        case L_VALUE_BOOL:
+        case L_VALUE_CHARACTER:
+        case L_VALUE_NUMBER:
+            break;
+        case L_VALUE_LIST:
+            l_vector_destroy(&value->value.list);
+            break;
+        case L_VALUE_VECTOR:
+            l_pvector_release(value->value.vector);
+            break;
+        case L_VALUE_MAP:
+            l_hash_map_release(value->value.map);
+            break;
+        case L_VALUE_STRING:
+            l_rope_release(value->value.rope);
+            break;
+        case L_VALUE_TASK:
+            l_task_release(value->value.task);
+            break;
+        case L_VALUE_ERROR:
+            break;
+        case L_VALUE_SYMBOL:
+            break;
+    }
+}
+
+l_value_t l_value_copy(l_value_t *value) {
+    if(value->type == L_VALUE_VECTOR) {
+        value->value.vector->ref_count++;
+        return *value;
+    }
+    if(value->type == L_VALUE_MAP) {
+        value->value.map->ref_count++;
+        return *value;
+    }
+    if(value->type == L_VALUE_STRING) {
+        value->value.rope->ref_count++;
+        return *value;
+    }
+    if(value->type == L_VALUE_TASK) {
+        value->value.task->ref_count++;
+        return *value;
+    }
+    if(value->type != L_VALUE_LIST) {
+        return *value;
+    }
+    l_value_t copy = *value;
+    l_vector_init(&copy.value.list, sizeof(l_value_t), value->value.list.length > 0 ? value->value.list.length : 1,
+            (void (*)(void *))l_value_destroy);
+    for(size_t i = 0; i < value->value.list.length; i++) {
+        l_value_t element = l_value_copy((l_value_t *)l_vector_get(&value->value.list, i));
+        l_vector_push(&copy.value.list, &element);
+    }
+    return copy;
+}
+
+l_value_t l_value_integer(long long number) {
+    return (l_value_t) {.type = L_VALUE_NUMBER, .value.long_value = number, .flags = L_VALUE_FLAG_INTEGER};
+}
+
+l_value_t l_value_real(double number) {
+    return (l_value_t) {.type = L_VALUE_NUMBER, .value.double_value = number, .flags = L_VALUE_FLAG_REAL};
+}
+
+l_value_t l_value_bool(bool boolean) {
+    return (l_value_t) {.type = L_VALUE_BOOL, .value.boolean = boolean};
+}
+
+l_value_t l_value_nil(void) {
+    return (l_value_t) {.type = L_VALUE_NIL};
+}
+
+l_value_t l_value_character(char character) {
+    return (l_value_t) {.type = L_VALUE_CHARACTER, .value.character = character};
+}
+
+l_value_t l_value_string(const char *string) {
+    return (l_value_t) {.type = L_VALUE_STRING, .value.rope = l_rope_from_string(string, strlen(string))};
+}
+
+// name must outlive the interpreter, it is interned as eternal
+l_value_t l_value_symbol(l_vector_t **string_table, const char *name) {
+    return (l_value_t) {.type = L_VALUE_SYMBOL, .value.symbol_index = l_intern_string(string_table, name, true)};
+}
+
+// Moves the elements into a new list, leaving nil behind in their slots.
+l_value_t l_value_list(l_value_t *elements, size_t count) {
+    l_value_t value = {.type = L_VALUE_LIST};
+    l_vector_init(&value.value.list, sizeof(l_value_t), count > 0 ? count : 1, (void (*)(void *))l_value_destroy);
+    for(size_t i = 0; i < count; i++) {
+        l_vector_push(&value.value.list, &elements[i]);
+        elements[i] = l_value_nil();
+    }
+    return value;
+}
+
+l_value_t l_value_error(l_vector_t **string_table, const char *fmt, ...) {
+    char *error_message;
+    va_list args;
+    va_start(args, fmt);
+    vasprintf(&error_message, fmt, args);
+    va_end(args);
+    return (l_value_t) {.type = L_VALUE_ERROR, .value.string_index = l_intern_string(string_table, error_message, false)};
+}
+
+static size_t l_hash_combine(size_t seed, size_t hash) {
+    return seed ^ (hash + (size_t)0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+static void l_hash_entry(l_value_t *key, l_value_t *value, void *context) {
+    // summed so that the hash does not depend on trie order
+    *(size_t *)context += l_hash_combine(l_value_hash(key), l_value_hash(value));
+}
+
+// Reals are keyed by their bits so that -0.0 and 0.0 stay apart; every
+// NaN maps to one pattern so that a NaN key can be found again.
+static unsigned long long l_double_bits(double number) {
+    unsigned long long bits = 0x7ff8000000000000ULL;
+    if(number == number) {
+        memcpy(&bits, &number, sizeof(bits));
+    }
+    return bits;
+}
+
+size_t l_value_hash(l_value_t *value) {
+    size_t hash = l_hash_combine(0, (size_t)value->type);
+    switch(value->type) {
+        case L_VALUE_NUMBER:
+            hash = l_hash_combine(hash, (size_t)value->flags);
+            if(value->flags & L_VALUE_FLAG_INTEGER) {
+                return l_hash_combine(hash, (size_t)value->value.long_value);
+            } else {
+                return l_hash_combine(hash, (size_t)l_double_bits(value->value.double_value));
+            }
+        case L_VALUE_ERROR:
+            return l_hash_combine(hash, value->value.string_index);
+        case L_VALUE_STRING:
+            return l_hash_combine(hash, l_rope_hash(value->value.rope));
+        case L_VALUE_SYMBOL:
+            return l_hash_combine(hash, value->value.symbol_index);
+        case L_VALUE_CHARACTER:
+            return l_hash_combine(hash, (unsigned char)value->value.character);
+        case L_VALUE_BOOL:
+            return l_hash_combine(hash, value->value.boolean);
+        case L_VALUE_NIL:
+            return hash;
+        case L_VALUE_LIST:
+            for(size_t i = 0; i < value->value.list.length; i++) {
+                hash = l_hash_combine(hash, l_value_hash((l_value_t *)l_vector_get(&value->value.list, i)));
+            }
+            return hash;
+        case L_VALUE_VECTOR:
+            for(size_t i = 0; i < value->value.vector->count; i++) {
+                hash = l_hash_combine(hash, l_value_hash(l_pvector_get(value->value.vector, i)));
+            }
+            return hash;
+        case L_VALUE_TASK:
+            return l_hash_combine(hash, (size_t)value->value.task);
+        case L_VALUE_MAP: {
+            size_t entries = 0;
+            l_hash_map_each(value->value.map, l_hash_entry, &entries);
+            return l_hash_combine(hash, entries);
+        }
+    }
+    return hash;
+}
+
+typedef struct lEqualContext {
+    l_hash_map_t *other;
+    bool equal;
+} l_equal_context_t;
+
+static void l_equal_entry(l_value_t *key, l_value_t *value, void *context) {
+    l_equal_context_t *equal = (l_equal_context_t *)context;
+    if(equal->equal) {
+        l_value_t *other = l_hash_map_get(equal->other, key);
+        equal->equal = other != NULL && l_value_equal(value, other);
+    }
+}
+
+// Structural equality; unlike (=) an integer never equals a real, and reals
+// compare by bits, so -0.0 is not 0.0 and NaN is NaN.
+bool l_value_equal(l_value_t *a, l_value_t *b) {
+    if(a->type != b->type) {
+        return false;
+    }
+    switch(a->type) {
+        case L_VALUE_NUMBER:
+            if(a->flags != b->flags) {
+                return false;
+            }
+            if(a->flags & L_VALUE_FLAG_INTEGER) {
+                return a->value.long_value == b->value.long_value;
+            }
+            return l_double_bits(a->value.double_value) == l_double_bits(b->value.double_value);
+        case L_VALUE_ERROR:
+            return a->value.string_index == b->value.string_index;
+        case L_VALUE_STRING:
+            return l_rope_equal(a->value.rope, b->value.rope);
+        case L_VALUE_SYMBOL:
+            return a->value.symbol_index == b->value.symbol_index;
+        case L_VALUE_CHARACTER:
+            return a->value.character == b->value.character;
+        case L_VALUE_BOOL:
+            return a->value.boolean == b->value.boolean;
+        case L_VALUE_NIL:
+            return true;
+        case L_VALUE_LIST:
+            if(a->value.list.length != b->value.list.length) {
+                return false;
+            }
+            for(size_t i = 0; i < a->value.list.length; i++) {
+                if(!l_value_equal((l_value_t *)l_vector_get(&a->value.list, i), (l_value_t *)l_vector_get(&b->value.list, i))) {
+                    return false;
+                }
+            }
+            return true;
+        case L_VALUE_VECTOR:
+            if(a->value.vector == b->value.vector) {
+                return true;
+            }
+            if(a->value.vector->count != b->value.vector->count) {
+                return false;
+            }
+            for(size_t i = 0; i < a->value.vector->count; i++) {
+                if(!l_value_equal(l_pvector_get(a->value.vector, i), l_pvector_get(b->value.vector, i))) {
+                    return false;
+                }
+            }
+            return true;
+        case L_VALUE_TASK:
+            return a->value.task == b->value.task;
+        case L_VALUE_MAP: {
+            if(a->value.map == b->value.map) {
+                return true;
+            }
+            if(a->value.map->count != b->value.map->count) {
+                return false;
+            }
+            l_equal_context_t context = {.other = b->value.map, .equal = true};
+            l_hash_map_each(a->value.map, l_equal_entry, &context);
+            return context.equal;
+        }
+    }
+    return false;
+}
+
+static l_pvector_node_t *l_pvector_node_create(bool leaf) {
+    l_pvector_node_t *node = (l_pvector_node_t *)malloc(sizeof(l_pvector_node_t));
+    node->ref_count = 1;
+    node->length = 0;
+    node->leaf = leaf;
+    return node;
+}
+
+static void l_pvector_node_release(l_pvector_node_t *node) {
+    if(--node->ref_count > 0) {
+        return;
+    }
+    for(size_t i = 0; i < node->length; i++) {
+        if(node->leaf) {
+            l_value_destroy(&node->slots.values[i]);
+        } else {
+            l_pvector_node_release(node->slots.children[i]);
+        }
+    }
+    free(node);
+}
+
+// Returns node itself if the caller holds the only reference, otherwise a
+// copy that takes over the caller's reference.
+static l_pvector_node_t *l_pvector_node_editable(l_pvector_node_t *node) {
+    if(node->ref_count == 1) {
+        return node;
+    }
+    l_pvector_node_t *copy = l_pvector_node_create(node->leaf);
+    copy->length = node->length;
+    for(size_t i = 0; i < node->length; i++) {
+        if(node->leaf) {
+            copy->slots.values[i] = l_value_copy(&node->slots.values[i]);
+        } else {
+            copy->slots.children[i] = node->slots.children[i];
+            copy->slots.children[i]->ref_count++;
+        }
+    }
+    node->ref_count--;
+    return copy;
+}
+
+static l_pvector_t *l_pvector_editable(l_pvector_t *vector) {
+    if(vector->ref_count == 1) {
+        return vector;
+    }
+    l_pvector_t *copy = (l_pvector_t *)malloc(sizeof(l_pvector_t));
+    *copy = *vector;
+    copy->ref_count = 1;
+    copy->root->ref_count++;
+    copy->tail->ref_count++;
+    vector->ref_count--;
+    return copy;
+}
+
+static size_t l_pvector_tail_offset(l_pvector_t *vector) {
+    if(vector->count < L_PVECTOR_WIDTH) {
+        return 0;
+    }
+    return ((vector->count - 1) >> L_PVECTOR_BITS) << L_PVECTOR_BITS;
+}
+
+l_pvector_t *l_pvector_create(void) {
+    l_pvector_t *vector = (l_pvector_t *)malloc(sizeof(l_pvector_t));
+    vector->ref_count = 1;
+    vector->count = 0;
+    vector->shift = L_PVECTOR_BITS;
+    vector->root = l_pvector_node_create(false);
+    vector->tail = l_pvector_node_create(true);
+    return vector;
+}
+
+void l_pvector_release(l_pvector_t *vector) {
+    if(--vector->ref_count > 0) {
+        return;
+    }
+    l_pvector_node_release(vector->root);
+    l_pvector_node_release(vector->tail);
+    free(vector);
+}
+
+l_value_t *l_pvector_get(l_pvector_t *vector, size_t index) {
+    if(index >= vector->count) {
+        return NULL;
+    }
+    if(index >= l_pvector_tail_offset(vector)) {
+        return &vector->tail->slots.values[index & L_PVECTOR_MASK];
+    }
+    l_pvector_node_t *node = vector->root;
+    for(unsigned level = vector->shift; level > 0; level -= L_PVECTOR_BITS) {
+        node = node->slots.children[(index >> level) & L_PVECTOR_MASK];
+    }
+    return &node->slots.values[index & L_PVECTOR_MASK];
+}
+
+static l_pvector_node_t *l_pvector_new_path(unsigned level, l_pvector_node_t *node) {
+    if(level == 0) {
+        return node;
+    }
+    l_pvector_node_t *parent = l_pvector_node_create(false);
+    parent->slots.children[0] = l_pvector_new_path(level - L_PVECTOR_BITS, node);
+    parent->length = 1;
+    return parent;
+}
+
+static void l_pvector_push_tail(size_t count, l_pvector_node_t *parent, unsigned level, l_pvector_node_t *tail) {
+    size_t index = ((count - 1) >> level) & L_PVECTOR_MASK;
+    if(level == L_PVECTOR_BITS) {
+        parent->slots.children[index] = tail;
+    } else if(index < parent->length) {
+        parent->slots.children[index] = l_pvector_node_editable(parent->slots.children[index]);
+        l_pvector_push_tail(count, parent->slots.children[index], level - L_PVECTOR_BITS, tail);
+    } else {
+        parent->slots.children[index] = l_pvector_new_path(level - L_PVECTOR_BITS, tail);
+    }
+    if(index >= parent->length) {
+        parent->length = index + 1;
+    }
+}
+
+// Consumes the caller's reference to vector and the value, and returns the
+// reference to the result.
+l_pvector_t *l_pvector_conj(l_pvector_t *vector, l_value_t value) {
+    vector = l_pvector_editable(vector);
+    if(vector->count - l_pvector_tail_offset(vector) < L_PVECTOR_WIDTH) {
+        vector->tail = l_pvector_node_editable(vector->tail);
+        vector->tail->slots.values[vector->tail->length++] = value;
+        vector->count++;
+        return vector;
+    }
+
+    // the tail is full, move it into the trie, growing a level if the root is full too
+    if((vector->count >> L_PVECTOR_BITS) > ((size_t)1 << vector->shift)) {
+        l_pvector_node_t *root = l_pvector_node_create(false);
+        root->slots.children[0] = vector->root;
+        root->slots.children[1] = l_pvector_new_path(vector->shift, vector->tail);
+        root->length = 2;
+        vector->root = root;
+        vector->shift += L_PVECTOR_BITS;
+    } else {
+        vector->root = l_pvector_node_editable(vector->root);
+        l_pvector_push_tail(vector->count, vector->root, vector->shift, vector->tail);
+    }
+    vector->tail = l_pvector_node_create(true);
+    vector->tail->slots.values[0] = value;
+    vector->tail->length = 1;
+    vector->count++;
+    return vector;
+}
+
+// Like l_pvector_conj; index must be at most vector->count.
+l_pvector_t *l_pvector_assoc(l_pvector_t *vector, size_t index, l_value_t value) {
+    if(index == vector->count) {
+        return l_pvector_conj(vector, value);
+    }
+    vector = l_pvector_editable(vector);
+    l_pvector_node_t *node;
+    if(index >= l_pvector_tail_offset(vector)) {
+        vector->tail = l_pvector_node_editable(vector->tail);
+        node = vector->tail;
+    } else {
+        vector->root = l_pvector_node_editable(vector->root);
+        node = vector->root;
+        for(unsigned level = vector->shift; level > 0; level -= L_PVECTOR_BITS) {
+            size_t child = (index >> level) & L_PVECTOR_MASK;
+            node->slots.children[child] = l_pvector_node_editable(node->slots.children[child]);
+            node = node->slots.children[child];
+        }
+    }
+    l_value_destroy(&node->slots.values[index & L_PVECTOR_MASK]);
+    node->slots.values[index & L_PVECTOR_MASK] = value;
+    return vector;
+}
+
+static l_hamt_node_t *l_hamt_node_create(size_t length) {
+    l_hamt_node_t *node = (l_hamt_node_t *)malloc(sizeof(l_hamt_node_t) + length * sizeof(l_hamt_entry_t));
+    node->ref_count = 1;
+    node->bitmap = 0;
+    node->collision = false;
+    node->length = length;
+    return node;
+}
+
+static void l_hamt_node_release(l_hamt_node_t *node) {
+    if(node == NULL || --node->ref_count > 0) {
+        return;
+    }
+    for(size_t i = 0; i < node->length; i++) {
+        if(node->entries[i].child != NULL) {
+            l_hamt_node_release(node->entries[i].child);
+        } else {
+            l_value_destroy(&node->entries[i].key);
+            l_value_destroy(&node->entries[i].value);
+        }
+    }
+    free(node);
+}
+
+// Returns an unshared version of node that takes over the caller's
+// reference. Unless insert_at is SIZE_MAX, the result has one more entry,
+// left uninitialized at insert_at.
+static l_hamt_node_t *l_hamt_node_editable(l_hamt_node_t *node, size_t insert_at) {
+    size_t grow = insert_at == SIZE_MAX ? 0 : 1;
+    if(node->ref_count == 1) {
+        if(grow) {
+            node = (l_hamt_node_t *)realloc(node, sizeof(l_hamt_node_t) + (node->length + 1) * sizeof(l_hamt_entry_t));
+            memmove(&node->entries[insert_at + 1], &node->entries[insert_at], (node->length - insert_at) * sizeof(l_hamt_entry_t));
+            node->length++;
+        }
+        return node;
+    }
+    l_hamt_node_t *copy = l_hamt_node_create(node->length + grow);
+    copy->bitmap = node->bitmap;
+    copy->collision = node->collision;
+    for(size_t i = 0, j = 0; i < node->length; i++, j++) {
+        if(j == insert_at) {
+            j++;
+        }
+        copy->entries[j] = node->entries[i];
+        if(node->entries[i].child != NULL) {
+            node->entries[i].child->ref_count++;
+        } else {
+            copy->entries[j].key = l_value_copy(&node->entries[i].key);
+            copy->entries[j].value = l_value_copy(&node->entries[i].value);
+        }
+    }
+    node->ref_count--;
+    return copy;
+}
+
+static l_hamt_node_t *l_hamt_merge(l_hamt_entry_t a, l_hamt_entry_t b, unsigned shift) {
+    if(shift >= sizeof(size_t) * CHAR_BIT) {
+        l_hamt_node_t *node = l_hamt_node_create(2);
+        node->collision = true;
+        node->entries[0] = a;
+        node->entries[1] = b;
+        return node;
+    }
+    unsigned bit_a = (a.hash >> shift) & L_PVECTOR_MASK;
+    unsigned bit_b = (b.hash >> shift) & L_PVECTOR_MASK;
+    if(bit_a == bit_b) {
+        l_hamt_node_t *node = l_hamt_node_create(1);
+        node->bitmap = (uint32_t)1 << bit_a;
+        node->entries[0] = (l_hamt_entry_t) {.child = l_hamt_merge(a, b, shift + L_PVECTOR_BITS)};
+        return node;
+    }
+    l_hamt_node_t *node = l_hamt_node_create(2);
+    node->bitmap = ((uint32_t)1 << bit_a) | ((uint32_t)1 << bit_b);
+    node->entries[bit_a < bit_b ? 0 : 1] = a;
+    node->entries[bit_a < bit_b ? 1 : 0] = b;
+    return node;
+}
+
+// Consumes the reference to node (NULL for an empty trie), the key and the value.
+static l_hamt_node_t *l_hamt_assoc(l_hamt_node_t *node, unsigned shift, size_t hash, l_value_t key, l_value_t value, bool *added) {
+    l_hamt_entry_t entry = {.child = NULL, .hash = hash, .key = key, .value = value};
+    if(node == NULL) {
+        node = l_hamt_node_create(1);
+        node->bitmap = (uint32_t)1 << ((hash >> shift) & L_PVECTOR_MASK);
+        node->entries[0] = entry;
+        *added = true;
+        return node;
+    }
+    if(node->collision) {
+        for(size_t i = 0; i < node->length; i++) {
+            if(l_value_equal(&node->entries[i].key, &key)) {
+                node = l_hamt_node_editable(node, SIZE_MAX);
+                l_value_destroy(&node->entries[i].value);
+                node->entries[i].value = value;
+                l_value_destroy(&key);
+                return node;
+            }
+        }
+        node = l_hamt_node_editable(node, node->length);
+        node->entries[node->length - 1] = entry;
+        *added = true;
+        return node;
+    }
+
+    uint32_t bit = (uint32_t)1 << ((hash >> shift) & L_PVECTOR_MASK);
+    size_t index = __builtin_popcount(node->bitmap & (bit - 1));
+    if(!(node->bitmap & bit)) {
+        node = l_hamt_node_editable(node, index);
+        node->bitmap |= bit;
+        node->entries[index] = entry;
+        *added = true;
+        return node;
+    }
+    node = l_hamt_node_editable(node, SIZE_MAX);
+    l_hamt_entry_t *existing = &node->entries[index];
+    if(existing->child != NULL) {
+        existing->child = l_hamt_assoc(existing->child, shift + L_PVECTOR_BITS, hash, key, value, added);
+    } else if(existing->hash == hash && l_value_equal(&existing->key, &key)) {
+        l_value_destroy(&existing->value);
+        existing->value = value;
+        l_value_destroy(&key);
+    } else {
+        *existing = (l_hamt_entry_t) {.child = l_hamt_merge(*existing, entry, shift + L_PVECTOR_BITS)};
+        *added = true;
+    }
+    return node;
+}
+
+static void l_hamt_each(l_hamt_node_t *node, void (*visit)(l_value_t *key, l_value_t *value, void *context), void *context) {
+    if(node == NULL) {
+        return;
+    }
+    for(size_t i = 0; i < node->length; i++) {
+        if(node->entries[i].child != NULL) {
+            l_hamt_each(node->entries[i].child, visit, context);
+        } else {
+            visit(&node->entries[i].key, &node->entries[i].value, context);
+        }
+    }
+}
+
+l_hash_map_t *l_hash_map_create(void) {
+    l_hash_map_t *map = (l_hash_map_t *)malloc(sizeof(l_hash_map_t));
+    map->ref_count = 1;
+    map->count = 0;
+    map->root = NULL;
+    return map;
+}
+
+void l_hash_map_release(l_hash_map_t *map) {
+    if(--map->ref_count > 0) {
+        return;
+    }
+    l_hamt_node_release(map->root);
+    free(map);
+}
+
+l_value_t *l_hash_map_get(l_hash_map_t *map, l_value_t *key) {
+    size_t hash = l_value_hash(key);
+    l_hamt_node_t *node = map->root;
+    unsigned shift = 0;
+    while(node != NULL) {
+        if(node->collision) {
+            for(size_t i = 0; i < node->length; i++) {
+                if(l_value_equal(&node->entries[i].key, key)) {
+                    return &node->entries[i].value;
+                }
+            }
+            return NULL;
+        }
+        uint32_t bit = (uint32_t)1 << ((hash >> shift) & L_PVECTOR_MASK);
+        if(!(node->bitmap & bit)) {
+            return NULL;
+        }
+        l_hamt_entry_t *entry = &node->entries[__builtin_popcount(node->bitmap & (bit - 1))];
+        if(entry->child == NULL) {
+            return entry->hash == hash && l_value_equal(&entry->key, key) ? &entry->value : NULL;
+        }
+        node = entry->child;
+        shift += L_PVECTOR_BITS;
+    }
+    return NULL;
+}
+
+// Consumes the caller's reference to map, the key and the value, and returns
+// the reference to the result.
+l_hash_map_t *l_hash_map_assoc(l_hash_map_t *map, l_value_t key, l_value_t value) {
+    if(map->ref_count > 1) {
+        l_hash_map_t *copy = l_hash_map_create();
+        copy->count = map->count;
+        copy->root = map->root;
+        if(copy->root != NULL) {
+            copy->root->ref_count++;
+        }
+        map->ref_count--;
+        map = copy;
+    }
+    bool added = false;
+    size_t hash = l_value_hash(&key);
+    map->root = l_hamt_assoc(map->root, 0, hash, key, value, &added);
+    if(added) {
+        map->count++;
+    }
+    return map;
+}
+
+void l_hash_map_each(l_hash_map_t *map, void (*visit)(l_value_t *key, l_value_t *value, void *context), void *context) {
+    l_hamt_each(map->root, visit, context);
+}
+
+static l_rope_t *l_rope_alloc(l_rope_kind_t kind, size_t length) {
+    l_rope_t *rope = (l_rope_t *)malloc(sizeof(l_rope_t));
+    rope->ref_count = 1;
+    rope->length = length;
+    rope->depth = 0;
+    rope->kind = kind;
+    return rope;
+}
+
+// Takes ownership of data, which must be NUL terminated at length.
+l_rope_t *l_rope_from_buffer(char *data, size_t length) {
+    l_rope_t *rope = l_rope_alloc(L_ROPE_LEAF, length);
+    rope->node.leaf.data = data;
+    rope->node.leaf.capacity = length + 1;
+    return rope;
+}
+
+l_rope_t *l_rope_from_string(const char *string, size_t length) {
+    char *data = (char *)malloc(length + 1);
+    memcpy(data, string, length);
+    data[length] = '\0';
+    return l_rope_from_buffer(data, length);
+}
+
+static void l_rope_release_children(l_rope_t *rope) {
+    switch(rope->kind) {
+        case L_ROPE_LEAF:
+            free(rope->node.leaf.data);
+            break;
+        case L_ROPE_CONCAT:
+            l_rope_release(rope->node.concat.left);
+            l_rope_release(rope->node.concat.right);
+            break;
+        case L_ROPE_SLICE:
+            l_rope_release(rope->node.slice.source);
+            break;
+    }
+}
+
+void l_rope_release(l_rope_t *rope) {
+    if(--rope->ref_count > 0) {
+        return;
+    }
+    l_rope_release_children(rope);
+    free(rope);
+}
+
+// Copies the characters [start, end) of rope to out.
+static void l_rope_copy_to(l_rope_t *rope, size_t start, size_t end, char *out) {
+    while(rope->kind == L_ROPE_CONCAT) {
+        l_rope_t *left = rope->node.concat.left;
+        if(end <= left->length) {
+            rope = left;
+            continue;
+        }
+        if(start < left->length) {
+            l_rope_copy_to(left, start, left->length, out);
+            out += left->length - start;
+            start = left->length;
+        }
+        start -= left->length;
+        end -= left->length;
+        rope = rope->node.concat.right;
+    }
+    const char *data = rope->kind == L_ROPE_LEAF
+        ? rope->node.leaf.data
+        : rope->node.slice.source->node.leaf.data + rope->node.slice.offset;
+    memcpy(out, data + start, end - start);
+}
+
+// Turns rope into a single leaf in place; the characters do not change, so
+// this is safe on shared ropes.
+const char *l_rope_flatten(l_rope_t *rope) {
+    if(rope->kind == L_ROPE_LEAF) {
+        return rope->node.leaf.data;
+    }
+    char *data = (char *)malloc(rope->length + 1);
+    l_rope_copy_to(rope, 0, rope->length, data);
+    data[rope->length] = '\0';
+    l_rope_release_children(rope);
+    rope->kind = L_ROPE_LEAF;
+    rope->depth = 0;
+    rope->node.leaf.data = data;
+    rope->node.leaf.capacity = rope->length + 1;
+    return data;
+}
+
+char l_rope_char_at(l_rope_t *rope, size_t index) {
+    while(rope->kind == L_ROPE_CONCAT) {
+        if(index < rope->node.concat.left->length) {
+            rope = rope->node.concat.left;
+        } else {
+            index -= rope->node.concat.left->length;
+            rope = rope->node.concat.right;
+        }
+    }
+    if(rope->kind == L_ROPE_LEAF) {
+        return rope->node.leaf.data[index];
+    }
+    return rope->node.slice.source->node.leaf.data[rope->node.slice.offset + index];
+}
+
+static size_t l_rope_count_leaves(l_rope_t *rope) {
+    if(rope->kind != L_ROPE_CONCAT) {
+        return 1;
+    }
+    return l_rope_count_leaves(rope->node.concat.left) + l_rope_count_leaves(rope->node.concat.right);
+}
+
+static void l_rope_collect_leaves(l_rope_t *rope, l_rope_t **leaves, size_t *count) {
+    if(rope->kind != L_ROPE_CONCAT) {
+        rope->ref_count++;
+        leaves[(*count)++] = rope;
+        return;
+    }
+    l_rope_collect_leaves(rope->node.concat.left, leaves, count);
+    l_rope_collect_leaves(rope->node.concat.right, leaves, count);
+}
+
+static l_rope_t *l_rope_concat_node(l_rope_t *left, l_rope_t *right) {
+    l_rope_t *rope = l_rope_alloc(L_ROPE_CONCAT, left->length + right->length);
+    rope->node.concat.left = left;
+    rope->node.concat.right = right;
+    rope->depth = (left->depth > right->depth ? left->depth : right->depth) + 1;
+    return rope;
+}
+
+static l_rope_t *l_rope_build_balanced(l_rope_t **leaves, size_t count) {
+    if(count == 1) {
+        return leaves[0];
+    }
+    size_t half = count / 2;
+    return l_rope_concat_node(l_rope_build_balanced(leaves, half), l_rope_build_balanced(leaves + half, count - half));
+}
+
+// Consumes rope and returns a tree of the same leaves with logarithmic depth.
+static l_rope_t *l_rope_rebalance(l_rope_t *rope) {
+    size_t count = 0;
+    l_rope_t **leaves = (l_rope_t **)malloc(sizeof(l_rope_t *) * l_rope_count_leaves(rope));
+    l_rope_collect_leaves(rope, leaves, &count);
+    l_rope_t *balanced = l_rope_build_balanced(leaves, count);
+    free(leaves);
+    l_rope_release(rope);
+    return balanced;
+}
+
+// An unshared leaf acts as a string builder: appending to it, or to the
+// rightmost leaf of an unshared concatenation, grows its buffer in place.
+static bool l_rope_append_in_place(l_rope_t *rope, l_rope_t *right) {
+    if(rope->ref_count != 1) {
+        return false;
+    }
+    if(rope->kind == L_ROPE_CONCAT) {
+        if(!l_rope_append_in_place(rope->node.concat.right, right)) {
+            return false;
+        }
+        rope->length += right->length;
+        return true;
+    }
+    if(rope->kind != L_ROPE_LEAF) {
+        return false;
+    }
+    size_t length = rope->length + right->length;
+    if(length + 1 > rope->node.leaf.capacity) {
+        size_t capacity = rope->node.leaf.capacity * 2;
+        rope->node.leaf.capacity = capacity > length + 1 ? capacity : length + 1;
+        rope->node.leaf.data = (char *)realloc(rope->node.leaf.data, rope->node.leaf.capacity);
+    }
+    l_rope_copy_to(right, 0, right->length, rope->node.leaf.data + rope->length);
+    rope->node.leaf.data[length] = '\0';
+    rope->length = length;
+    return true;
+}
+
+// Consumes both references and returns the reference to the result.
+l_rope_t *l_rope_concat(l_rope_t *left, l_rope_t *right) {
+    if(right->length == 0) {
+        l_rope_release(right);
+        return left;
+    }
+    if(left->length == 0) {
+        l_rope_release(left);
+        return right;
+    }
+    if(right->length <= L_ROPE_SHORT && l_rope_append_in_place(left, right)) {
+        l_rope_release(right);
+        return left;
+    }
+    if(left->length + right->length <= L_ROPE_SHORT) {
+        size_t length = left->length + right->length;
+        char *data = (char *)malloc(length + 1);
+        l_rope_copy_to(left, 0, left->length, data);
+        l_rope_copy_to(right, 0, right->length, data + left->length);
+        data[length] = '\0';
+        l_rope_release(left);
+        l_rope_release(right);
+        return l_rope_from_buffer(data, length);
+    }
+    l_rope_t *rope = l_rope_concat_node(left, right);
+    if(rope->depth > L_ROPE_MAX_DEPTH) {
+        rope = l_rope_rebalance(rope);
+    }
+    return rope;
+}
+
+// Returns a new reference to the characters [start, end) of rope, sharing
+// its leaves unless the slice is short enough to copy.
+l_rope_t *l_rope_slice(l_rope_t *rope, size_t start, size_t end) {
+    if(start == 0 && end == rope->length) {
+        rope->ref_count++;
+        return rope;
+    }
+    size_t length = end - start;
+    if(length <= L_ROPE_SHORT) {
+        char *data = (char *)malloc(length + 1);
+        l_rope_copy_to(rope, start, end, data);
+        data[length] = '\0';
+        return l_rope_from_buffer(data, length);
+    }
+    l_rope_t *slice;
+    switch(rope->kind) {
+        case L_ROPE_LEAF:
+            slice = l_rope_alloc(L_ROPE_SLICE, length);
+            slice->node.slice.source = rope;
+            slice->node.slice.offset = start;
+            rope->ref_count++;
+            return slice;
+        case L_ROPE_SLICE:
+            slice = l_rope_alloc(L_ROPE_SLICE, length);
+            slice->node.slice.source = rope->node.slice.source;
+            slice->node.slice.offset = rope->node.slice.offset + start;
+            slice->node.slice.source->ref_count++;
+            return slice;
+        case L_ROPE_CONCAT:
+            break;
+    }
+    l_rope_t *left = rope->node.concat.left;
+    if(end <= left->length) {
+        return l_rope_slice(left, start, end);
+    }
+    if(start >= left->length) {
+        return l_rope_slice(rope->node.concat.right, start - left->length, end - left->length);
+    }
+    return l_rope_concat(l_rope_slice(left, start, left->length),
+                         l_rope_slice(rope->node.concat.right, 0, end - left->length));
+}
+
+bool l_rope_equal(l_rope_t *a, l_rope_t *b) {
+    if(a == b) {
+        return true;
+    }
+    return a->length == b->length && memcmp(l_rope_flatten(a), l_rope_flatten(b), a->length) == 0;
+}
+
+size_t l_rope_hash(l_rope_t *rope) {
+    // FNV-1a
+    size_t hash = (size_t)0xcbf29ce484222325ULL;
+    const unsigned char *data = (const unsigned char *)l_rope_flatten(rope);
+    for(size_t i = 0; i < rope->length; i++) {
+        hash = (hash ^ data[i]) * (size_t)0x100000001b3ULL;
+    }
+    return hash;
+}
+
+l_value_t l_parse_list(l_tokenizer_t *tokenizer, l_vector_t **string_table) {
+    l_value_t value = {.type = L_VALUE_LIST };
+    l_vector_init(&value.value.list, sizeof(l_value_t), 4, (void (*)(void *))l_value_destroy);
+
+    l_token_t token = l_tokenizer_next(tokenizer);
+
+    while(token.type != TOKEN_RPAREN) {
+        l_value_t expression = l_parse_expression(token, tokenizer, string_table);
+        if(expression.type == L_VALUE_ERROR) {
+            l_vector_destroy(&value.value.list);
+            return expression;
+        }
+        l_vector_push(&value.value.list, &expression);
+        token = l_tokenizer_next(tokenizer);
+    }
+    return value;
+}
+
+// [a b] and {k v} read as (vector a b) and (hash-map k v), the same way 'x
+// reads as (quote x), so collection literals are built by evaluation.
+l_value_t l_parse_collection(l_tokenizer_t *tokenizer, l_vector_t **string_table, const char *constructor, l_token_type_t closing) {
+    l_value_t value = {.type = L_VALUE_LIST };
+    l_vector_init(&value.value.list, sizeof(l_value_t), 4, (void (*)(void *))l_value_destroy);
+
+    l_value_t head = {.type = L_VALUE_SYMBOL, .value.symbol_index = l_intern_string(string_table, constructor, true)};
+    l_vector_push(&value.value.list, &head);
+
+    l_token_t token = l_tokenizer_next(tokenizer);
+    while(token.type != closing) {
+        l_value_t expression = l_parse_expression(token, tokenizer, string_table);
+        if(expression.type == L_VALUE_ERROR) {
+            l_vector_destroy(&value.value.list);
+            return expression;
+        }
+        l_vector_push(&value.value.list, &expression);
+        token = l_tokenizer_next(tokenizer);
+    }
+    return value;
+}
+
+l_value_t l_parse_quote(l_tokenizer_t *tokenizer, l_vector_t **string_table) {
+    l_value_t value = {.type = L_VALUE_LIST };
+    l_vector_init(&value.value.list, sizeof(l_value_t), 2, (void (*)(void *))l_value_destroy);
+
+    l_value_t quote = {.type = L_VALUE_SYMBOL, .value.symbol_index = l_intern_string(string_table, "quote", true)};
+    l_vector_push(&value.value.list, &quote);
+
+    l_token_t token = l_tokenizer_next(tokenizer);
+    l_value_t expression = l_parse_expression(token, tokenizer, string_table);
+    if(expression.type == L_VALUE_ERROR) {
+        return expression;
+    }
+    l_vector_push(&value.value.list, &expression);
+    return value;
+}
+
+l_value_t l_parse_atom(l_token_t *token, l_vector_t **string_table) {
+    switch(token->type) {
+        case TOKEN_REAL: {
+            l_value_t value = {.type = L_VALUE_NUMBER, .value.double_value = token->value.real, .flags = L_VALUE_FLAG_REAL};
+            return value;
+        }
+        case TOKEN_INTEGER: {
+            l_value_t value = {.type = L_VALUE_NUMBER, .value.long_value = token->value.number, .flags = L_VALUE_FLAG_INTEGER};
+            return value;
+        }
+        case TOKEN_STRING: {
+            l_value_t value = {.type = L_VALUE_STRING, .value.rope = l_rope_from_buffer(token->value.string, strlen(token->value.string))};
+            return value;
+        }
+        case TOKEN_BOOLEAN: {
+            l_value_t value = {.type = L_VALUE_BOOL, .value.boolean = token->value.boolean};
+            return value;
+        }
+        case TOKEN_CHARACTER: {
+            l_value_t value = {.type = L_VALUE_CHARACTER, .value.character = token->value.character};
+            return value;
+        }
+        case TOKEN_SYMBOL: {
+            l_value_t value = {.type = L_VALUE_SYMBOL, .value.symbol_index = l_intern_string(string_table, token->value.symbol, false)};
+            return value;
+        }
+        default: {
+            char *error_message;
+            asprintf(&error_message, "Error: Cannot convert token to value, type=%d\n", token->type);
+            l_value_t value = {.type = L_VALUE_ERROR, .value.string_index = l_intern_string(string_table, error_message, false)};
+            return value;
+        }
+
+    }
+}
+
+size_t l_intern_string(l_vector_t **string_table, const char *string, bool eternal) {
+    for(size_t i = 0; i < (*string_table)->length; i++) {
+        l_ref_counted_t *ref_counted = (l_ref_counted_t *)l_vector_get(*string_table, i);
+        if(strcmp((char *)ref_counted->data, string) == 0) {
+            ref_counted->ref_count++;
+            return i;
+        }
+    }
+    l_ref_counted_t ref_counted;
+    l_ref_counted_init(&ref_counted, (void*)string, eternal ? NULL : (void (*)(void *))free);
 
     l_vector_push(*string_table, &ref_counted);
     return (*string_table)->length - 1;
@@ -678,6 +3549,18 @@ void l_debug_print_token(l_token_t *token) {
         case TOKEN_CHARACTER: {
             printf("#\\%c", token->value.character);
         } break;
+        case TOKEN_LBRACKET: {
+            printf("[");
+        } break;
+        case TOKEN_RBRACKET: {
+            printf("]");
+        } break;
+        case TOKEN_LBRACE: {
+            printf("{");
+        } break;
+        case TOKEN_RBRACE: {
+            printf("}");
+        } break;
         case TOKEN_EOF: {
             printf("EOF");
         } break;
@@ -693,42 +3576,85 @@ void l_debug_print_token(l_token_t *token) {
 
 }
 void l_debug_print_value(l_value_t *value, l_vector_t *string_table) {
+    l_fprint_value(stdout, value, string_table);
+}
+
+typedef struct lFprintContext {
+    FILE *out;
+    l_vector_t *string_table;
+    bool first;
+} l_fprint_context_t;
+
+static void l_fprint_entry(l_value_t *key, l_value_t *value, void *context) {
+    l_fprint_context_t *print = (l_fprint_context_t *)context;
+    if(!print->first) {
+        fprintf(print->out, ", ");
+    }
+    print->first = false;
+    l_fprint_value(print->out, key, print->string_table);
+    fprintf(print->out, " ");
+    l_fprint_value(print->out, value, print->string_table);
+}
+
+void l_fprint_value(FILE *out, l_value_t *value, l_vector_t *string_table) {
     switch(value->type) {
         case L_VALUE_ERROR: {
-            printf("ERROR: %s", l_get_interned_string(string_table, value->value.string_index));
+            fprintf(out, "ERROR: %s", l_get_interned_string(string_table, value->value.string_index));
         } break;
         case L_VALUE_NUMBER: {
             if(value->flags & L_VALUE_FLAG_INTEGER) {
-                printf("%lld", value->value.long_value);
+                fprintf(out, "%lld", value->value.long_value);
             } else {
-                printf("%f", value->value.double_value);
+                fprintf(out, "%f", value->value.double_value);
             }
         } break;
         case L_VALUE_STRING: {
-            printf("\"%s\"", l_get_interned_string(string_table, value->value.string_index));
+            fprintf(out, "\"");
+            fwrite(l_rope_flatten(value->value.rope), 1, value->value.rope->length, out);
+            fprintf(out, "\"");
         } break;
         case L_VALUE_CHARACTER: {
-            printf("\\%c", value->value.character);
+            fprintf(out, "\\%c", value->value.character);
         } break;
         case L_VALUE_BOOL: {
-            printf("%s", value->value.boolean ? "true" : "false");
+            fprintf(out, "%s", value->value.boolean ? "true" : "false");
         } break;
         case L_VALUE_NIL: {
-            printf("nil");
+            fprintf(out, "nil");
         } break;
         case L_VALUE_SYMBOL: {
-            printf("%s", l_get_interned_string(string_table, value->value.symbol_index));
+            fprintf(out, "%s", l_get_interned_string(string_table, value->value.symbol_index));
         } break;
         case L_VALUE_LIST: {
-            printf("(");
+            fprintf(out, "(");
             for(size_t i = 0; i < value->value.list.length; i++) {
                 l_value_t *element = (l_value_t *)l_vector_get(&value->value.list, i);
-                l_debug_print_value(element, string_table);
+                l_fprint_value(out, element, string_table);
                 if(i < value->value.list.length - 1) {
-                    printf(" ");
+                    fprintf(out, " ");
                 }
             }
-            printf(")");
+            fprintf(out, ")");
+        } break;
+        case L_VALUE_VECTOR: {
+            l_pvector_t *vector = value->value.vector;
+            fprintf(out, "[");
+            for(size_t i = 0; i < vector->count; i++) {
+                l_fprint_value(out, l_pvector_get(vector, i), string_table);
+                if(i < vector->count - 1) {
+                    fprintf(out, " ");
+                }
+            }
+            fprintf(out, "]");
+        } break;
+        case L_VALUE_MAP: {
+            l_fprint_context_t context = {.out = out, .string_table = string_table, .first = true};
+            fprintf(out, "{");
+            l_hash_map_each(value->value.map, l_fprint_entry, &context);
+            fprintf(out, "}");
+        } break;
+        case L_VALUE_TASK: {
+            fprintf(out, "<task%s>", value->value.task->done ? " done" : "");
         } break;
     }
 }
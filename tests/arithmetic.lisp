@@ -0,0 +1,34 @@
+(add 1 2 3)
+(- 10 3 2)
+(- 5)
+(/ 10 4)
+(/ 12 4)
+(* 9223372036854775807 2)
+(+ 1 2.5 3)
+(< 1 2 3)
+(< 1 3 2)
+(= 2 2.0)
+'(1 2 (3))
+(foo 1)
+(+ 1 (* 2 3) (- 4 1))
+()
+(/ 1 0)
+(+ 1.5 2 (* 2.0 3))
+(- 2.5)
+(/ 1.0 0)
+(< 1.5 2)
+'(a "s\"x" \c #t 1.25 (b))
+foo
+(1 2)
+(+ 1 '(2))
+(+ 1 (foo) 3)
+(+ 9223372036854775807 1)
+(/ -9223372036854775808 -1)
+(* 3 4 2.5 2)
+(/ 7 2 2)
+(/ 8 2 0)
+(/ 8 2.0 0)
+(- 1 2.5 1)
+(= 9007199254740993 9007199254740992)
+(< 1 2 2.5 3)
+(> 3 2 2)
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Runs every tests/*.lisp through the interpreter and through the C that
+# --emit-c translates it to, built as a shared object and run with --load.
+# Both must print the lines recorded in the matching .expected file. Each
+# run starts in a fresh directory, so scripts can create sockets and files
+# there. Its stdin is a FIFO named fifo in that directory, which the script
+# may open to write to itself.
+#
+# usage: tests/differential.sh interpreter
+# CC and CFLAGS pick the compiler for the emitted scripts.
+
+root=$(pwd)
+interpreter=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+status=0
+
+# run name mode command...
+run() {
+    name=$1
+    mode=$2
+    shift 2
+    mkdir "$work/$name.$mode.d"
+    mkfifo "$work/$name.$mode.d/fifo"
+    # stdin is opened for reading and writing, so opening it does not wait
+    # for a writer. Descriptors this shell inherited are closed, so the ones
+    # a script opens are numbered from 3 however the harness was started.
+    (cd "$work/$name.$mode.d" &&
+        timeout 10 "$@" 0<>fifo 3>&- 4>&- 5>&- 6>&- 7>&- 8>&- 9>&-) > "$work/$name.$mode" 2>&1
+}
+
+for script in tests/*.lisp; do
+    name=$(basename "$script" .lisp)
+    expected=tests/$name.expected
+    run "$name" evaluated "$interpreter" "$root/$script"
+    "$interpreter" --emit-c "$script" > "$work/$name.c" &&
+        ${CC:-cc} ${CFLAGS:-} -fPIC -shared -I. -o "$work/$name.so" "$work/$name.c" &&
+        run "$name" emitted "$interpreter" --load "$work/$name.so"
+    failed=0
+    for mode in evaluated emitted; do
+        if ! cmp -s "$expected" "$work/$name.$mode"; then
+            echo "FAIL $name ($mode)"
+            diff "$expected" "$work/$name.$mode" | head -20
+            failed=1
+        fi
+    done
+    if [ $failed -eq 0 ]; then
+        echo "ok   $name"
+    else
+        status=1
+    fi
+done
+exit $status
@@ -0,0 +1,14 @@
+(spawn (fd-write 6 (fd-read (unix-accept (unix-listen "echo.sock")) 64)))
+(yield)
+(unix-connect "echo.sock")
+(spawn (fd-write 5 "hello, echo"))
+(fd-read 5 64)
+(spawn (fd-write 6 (str "<" (fd-read 6 4) ">")))
+(spawn (fd-write 6 (str "<" (fd-read 6 4) ">")))
+(fd-write 5 "pingpong")
+(sleep 10)
+(fd-read 5 64)
+(spawn (fd-close 5))
+(fd-read 5 64)
+(fd-read 6 64)
+(spawn (fd-write 1 "unawaited task ran"))
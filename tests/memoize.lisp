@@ -0,0 +1,30 @@
+(memoize (+ 1 2))
+(memoize (add 1 2))
+(memoize (+ 1 2.0))
+(memoize (str "ab" "cd"))
+(memoize (str (str "a" "b") "cd"))
+(memoize (conj [1 2] '(a b)))
+(memoize (conj [1 2] '(a b)))
+(memoize (get {"k" 1} "k"))
+(memoize (/ 1 0))
+(memoize (sleep 1))
+(memoize 3)
+(memoize (update {1 2} 1 '+ 3))
+(memoize (update {1 3} 1 'fd-close))
+(memoize (update {1 {2 3}} 1 'update 2 'fd-close))
+(memoize (update {1 {2 3}} 1 'update 2 '* 5))
+(stats)
+(memoize-limit 2)
+(memoize (+ 1 2))
+(memoize (+ 2 2))
+(memoize (+ 3 2))
+(memoize (+ 1 2))
+(stats)
+(memoize-limit 0)
+(update {1 2} 1 'memoize 3)
+(memoize (/ 1.0 0.0))
+(memoize (/ 1.0 -0.0))
+(memoize (* -0.0 1.0))
+(memoize (* 0.0 1.0))
+(memoize (* -0.0 1.0))
+(stats)
@@ -0,0 +1,7 @@
+(file-open "fifo" "w")
+(spawn (fd-write 1 (fd-read 0 3)))
+(spawn (fd-write 1 (fd-read 0 3)))
+(fd-write 4 "abc")
+(sleep 10)
+(fd-write 4 "def")
+(sleep 10)
@@ -0,0 +1,16 @@
+"hello"
+(str "a" "b" 1 2.5 \c [1 "x"])
+(string-length (str "hello, " "world"))
+(substring "hello world" 6)
+(substring "hello world" 2 5)
+(string-ref "abc" 1)
+(string-ref "abc" 3)
+(intern (str "fo" "o"))
+(get {"key" 1} (str "ke" "y"))
+(= 1 1)
+(substring (str "0123456789012345678901234567890123456789" "0123456789012345678901234567890123456789" "abcdefghij") 35 85)
+(substring (str "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij" "0123456789012345678901234567890123456789012345678901234567890123456789") 60 130)
+(string-ref (str "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij" "0123456789012345678901234567890123456789012345678901234567890123456789") 69)
+(string-ref (str "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij" "0123456789012345678901234567890123456789012345678901234567890123456789") 75)
+(substring (substring "ABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJ" 5 115) 10 90)
+(string-ref (substring (substring "ABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJABCDEFGHIJ" 5 115) 10 90) 0)